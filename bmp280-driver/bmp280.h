@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef BMP280_H
+#define BMP280_H
+
+#include <linux/types.h>
+
+/**
+ * dig (digital compensation parameters) data
+ * Described in 3.11.2 in the datasheet.
+ */
+struct bmp280_calib_data {
+	u16 t1;
+	s16 t2, t3;
+	u16 p1;
+	s16 p2, p3, p4, p5, p6, p7, p8, p9;
+};
+
+/**
+ * A compensated sample
+ *
+ * Temperature in millidegrees celsius
+ * Pressure in pascals, in a "Q24.8 format"
+ */
+struct bmp280_sample {
+	s32 temperature;
+	u32 pressure;
+};
+
+/*
+ * Raw 20-bit ADC values of one measurement
+ *
+ * This is the record queued by the polling core, so it starts with the
+ * timestamp the core fills in
+ */
+struct bmp280_raw_sample {
+	u64 timestamp; // CLOCK_MONOTONIC in nanoseconds
+	s32 adc_t;
+	s32 adc_p;
+};
+
+s32 bmp280_compensate_temperature(const struct bmp280_calib_data *calib,
+				  s32 adc_t, s32 *t_fine);
+u32 bmp280_compensate_pressure(const struct bmp280_calib_data *calib,
+			       s32 adc_p, s32 t_fine);
+void bmp280_compensate(const struct bmp280_calib_data *calib, s32 adc_t,
+		       s32 adc_p, struct bmp280_sample *sample);
+void bmp280_compensate_batch(const struct bmp280_calib_data *calib,
+			     const struct bmp280_raw_sample *raw,
+			     struct bmp280_sample *samples, unsigned int count);
+
+#endif /* BMP280_H */
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Compensation formulas for the bmp280
+ *
+ * These only depend on the calibration data and raw ADC values passed in, and
+ * hold no state, so they can be built and checked outside of the driver.
+ */
+
+#include <linux/types.h>
+#include "bmp280.h"
+
+/**
+ * Compensate temperature function from 3.11.3 of the datasheet
+ *
+ * Stores the fine temperature needed for pressure compensation in t_fine
+ * Returns temperature in millidegree celsius
+ */
+s32 bmp280_compensate_temperature(const struct bmp280_calib_data *calib,
+				  s32 adc_t, s32 *t_fine)
+{
+	s32 var1, var2, T;
+
+	var1 = ((((adc_t >> 3) - ((s32)calib->t1 << 1)))
+		* ((s32)calib->t2)) >> 11;
+
+	var2 = (((((adc_t >> 4) - ((s32)calib->t1))
+		* ((adc_t >> 4) - ((s32)calib->t1))) >> 12)
+		* ((s32)calib->t3)) >> 14;
+
+	*t_fine = var1 + var2;
+
+	T = (*t_fine * 5 + 128) >> 8;
+
+	return T;
+}
+
+/**
+ * Compensate pressure function from 3.11.3 of the datasheet
+ *
+ * t_fine comes from bmp280_compensate_temperature
+ * Returns pressure in pascals, in a "Q24.8 format"
+ */
+u32 bmp280_compensate_pressure(const struct bmp280_calib_data *calib,
+			       s32 adc_p, s32 t_fine)
+{
+	s64 var1, var2, p;
+
+	var1 = ((s64)t_fine) - 128000;
+	var2 = var1 * var1 * (s64)calib->p6;
+	var2 = var2 + ((var1 * (s64)calib->p5) << 17);
+	var2 = var2 + (((s64)calib->p4) << 35);
+	var1 = ((var1 * var1 * (s64)calib->p3) >> 8)
+		+ ((var1 * (s64)calib->p2) << 12);
+	var1 = (((((s64)1) << 47) + var1)) * ((s64)calib->p1) >> 33;
+
+	if (var1 == 0)
+		return 0; // Avoid division by zero
+
+	p = 1048576 - adc_p;
+	p = (((p << 31) - var2) * 3125) / var1;
+	var1 = (((s64)calib->p9) * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (((s64)calib->p8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((s64)calib->p7) << 4);
+
+	return (u32)p;
+}
+
+// Compensates both raw ADC values of a measurement into sample
+void bmp280_compensate(const struct bmp280_calib_data *calib, s32 adc_t,
+		       s32 adc_p, struct bmp280_sample *sample)
+{
+	s32 t_fine;
+
+	sample->temperature = bmp280_compensate_temperature(calib, adc_t,
+							    &t_fine);
+	sample->pressure = bmp280_compensate_pressure(calib, adc_p, t_fine);
+}
+
+/*
+ * Compensates count raw samples into samples
+ *
+ * Every sample still needs its own s64 division, so this is no faster per
+ * sample than bmp280_compensate(). The gain is only that the work runs once
+ * per batch, outside of the sampling path.
+ */
+void bmp280_compensate_batch(const struct bmp280_calib_data *calib,
+			     const struct bmp280_raw_sample *raw,
+			     struct bmp280_sample *samples, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		bmp280_compensate(calib, raw[i].adc_t, raw[i].adc_p,
+				  &samples[i]);
+}
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests for the bmp280 compensation formulas
+ *
+ * The formulas are built into this module directly, so the tests don't need
+ * the driver or a sensor. Run with:
+ *
+ *	sudo insmod bmp280_compensate_test.ko
+ *	sudo cat /sys/kernel/debug/kunit/bmp280_compensate/results
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include "bmp280_compensate.c"
+
+#define BENCH_SAMPLES (1 << 20)
+#define BENCH_BATCH 16
+
+// Calibration and ADC example from 3.12 of the datasheet
+static const struct bmp280_calib_data datasheet_calib = {
+	.t1 = 27504, .t2 = 26435, .t3 = -1000,
+	.p1 = 36477, .p2 = -10685, .p3 = 3024, .p4 = 2855, .p5 = 140,
+	.p6 = -7, .p7 = 15500, .p8 = -14600, .p9 = 6000,
+};
+
+#define DATASHEET_ADC_T 519888
+#define DATASHEET_ADC_P 415148
+#define DATASHEET_T 2508
+#define DATASHEET_P 25767233
+
+static void bmp280_compensate_datasheet_test(struct kunit *test)
+{
+	struct bmp280_sample sample;
+	s32 t_fine;
+
+	KUNIT_EXPECT_EQ(test, bmp280_compensate_temperature(&datasheet_calib,
+							    DATASHEET_ADC_T,
+							    &t_fine),
+			DATASHEET_T);
+	KUNIT_EXPECT_EQ(test, t_fine, 128422);
+
+	bmp280_compensate(&datasheet_calib, DATASHEET_ADC_T, DATASHEET_ADC_P,
+			  &sample);
+	KUNIT_EXPECT_EQ(test, sample.temperature, DATASHEET_T);
+	KUNIT_EXPECT_EQ(test, sample.pressure, DATASHEET_P);
+}
+
+// A zero p1 would divide by zero, the formula returns 0 instead
+static void bmp280_compensate_zero_p1_test(struct kunit *test)
+{
+	struct bmp280_calib_data calib = datasheet_calib;
+	struct bmp280_sample sample;
+
+	calib.p1 = 0;
+	bmp280_compensate(&calib, DATASHEET_ADC_T, DATASHEET_ADC_P, &sample);
+	KUNIT_EXPECT_EQ(test, sample.temperature, DATASHEET_T);
+	KUNIT_EXPECT_EQ(test, sample.pressure, 0);
+}
+
+// The batch has to give the same results as compensating one at a time
+static void bmp280_compensate_batch_test(struct kunit *test)
+{
+	struct bmp280_raw_sample raw[BENCH_BATCH];
+	struct bmp280_sample samples[BENCH_BATCH];
+	struct bmp280_sample expected;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		raw[i].timestamp = i;
+		raw[i].adc_t = DATASHEET_ADC_T + i * 64;
+		raw[i].adc_p = DATASHEET_ADC_P - i * 64;
+	}
+	raw[0].adc_t = DATASHEET_ADC_T;
+	raw[0].adc_p = DATASHEET_ADC_P;
+
+	bmp280_compensate_batch(&datasheet_calib, raw, samples, BENCH_BATCH);
+
+	KUNIT_EXPECT_EQ(test, samples[0].temperature, DATASHEET_T);
+	KUNIT_EXPECT_EQ(test, samples[0].pressure, DATASHEET_P);
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		bmp280_compensate(&datasheet_calib, raw[i].adc_t, raw[i].adc_p,
+				  &expected);
+		KUNIT_EXPECT_EQ(test, samples[i].temperature,
+				expected.temperature);
+		KUNIT_EXPECT_EQ(test, samples[i].pressure, expected.pressure);
+	}
+}
+
+/*
+ * Not a correctness test, reports the cost per sample of compensating one
+ * sample at a time against batches of BENCH_BATCH
+ */
+static void bmp280_compensate_bench(struct kunit *test)
+{
+	struct bmp280_raw_sample *raw;
+	struct bmp280_sample *samples;
+	u64 start, single_ns, batch_ns;
+	unsigned int i;
+
+	raw = kunit_kmalloc_array(test, BENCH_SAMPLES, sizeof(*raw),
+				  GFP_KERNEL);
+	samples = kunit_kmalloc_array(test, BENCH_SAMPLES, sizeof(*samples),
+				      GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, raw);
+	KUNIT_ASSERT_NOT_NULL(test, samples);
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		raw[i].adc_t = DATASHEET_ADC_T + (i & 0x3FF);
+		raw[i].adc_p = DATASHEET_ADC_P - (i & 0x3FF);
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_SAMPLES; i++)
+		bmp280_compensate(&datasheet_calib, raw[i].adc_t, raw[i].adc_p,
+				  &samples[i]);
+	single_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_SAMPLES; i += BENCH_BATCH)
+		bmp280_compensate_batch(&datasheet_calib, &raw[i], &samples[i],
+					BENCH_BATCH);
+	batch_ns = ktime_get_ns() - start;
+
+	kunit_info(test, "%u samples: single %llu ns/sample, batch %llu ns/sample\n",
+		   BENCH_SAMPLES, single_ns / BENCH_SAMPLES,
+		   batch_ns / BENCH_SAMPLES);
+}
+
+static struct kunit_case bmp280_compensate_cases[] = {
+	KUNIT_CASE(bmp280_compensate_datasheet_test),
+	KUNIT_CASE(bmp280_compensate_zero_p1_test),
+	KUNIT_CASE(bmp280_compensate_batch_test),
+	KUNIT_CASE_SLOW(bmp280_compensate_bench),
+	{}
+};
+
+static struct kunit_suite bmp280_compensate_suite = {
+	.name = "bmp280_compensate",
+	.test_cases = bmp280_compensate_cases,
+};
+
+kunit_test_suite(bmp280_compensate_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("KUnit tests for the bmp280 compensation formulas");
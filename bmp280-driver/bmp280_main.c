@@ -0,0 +1,1867 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/sysfs.h>
+#include <linux/types.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/i2c.h>
+#include <linux/regmap.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/kfifo.h>
+#include <linux/idr.h>
+#include <linux/slab.h>
+#include <linux/cdev.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/pm_runtime.h>
+#include "bmp280.h"
+#include "bmp280_uapi.h"
+#include "sensor_poll.h"
+
+#define CREATE_TRACE_POINTS
+#include "bmp280_trace.h"
+
+#define CLASS_NAME "bmp280"
+#define REG_DATA_END	0xFC
+#define REG_TEMP	0xFA
+#define REG_PRESS	0xF7
+#define REG_CONFIG	0xF5
+#define REG_CTRL_MEAS	0xF4
+#define REG_STATUS	0xF3
+#define REG_RESET	0xE0
+#define REG_ID		0xD0
+#define REG_CALIB_START	0x88
+#define REG_CALIB_END	0x9F
+
+#define REG_TEMP_LEN	3
+#define REG_PRESS_LEN	3
+#define REG_CALIB_LEN	24
+#define RESET_VALUE	0xB6
+
+#define CTRL_MEAS_MODE_MASK	0x03 // 0b00000011
+
+// Measurement time constants from 3.8.1 of the datasheet, in microseconds
+#define MEAS_TIME_BASE_TYP	1000
+#define MEAS_TIME_BASE_MAX	1250
+#define MEAS_TIME_PER_OSRS_TYP	2000
+#define MEAS_TIME_PER_OSRS_MAX	2300
+#define MEAS_TIME_PRESS_TYP	500
+#define MEAS_TIME_PRESS_MAX	575
+
+// Interval between status register reads while waiting for a conversion
+#define STATUS_POLL_US		500
+
+// Raw samples captured before compensation. Must be a power of 2
+#define RAW_FIFO_SIZE		64
+// Number of raw samples compensated per pass
+#define RAW_BATCH_SIZE		16
+// Compensated records waiting for chardev readers. Must be a power of 2
+#define RECORD_FIFO_SIZE	64
+// Records copied to userspace per read
+#define READ_BATCH_SIZE		16
+
+// Maximum number of sensors, which is the size of the minor range
+#define BMP280_MAX_DEVICES	32
+
+// Time without readers before the sensor is put to sleep
+#define AUTOSUSPEND_MS		2000
+
+#define POLL_INTERVAL_MIN	5
+#define POLL_INTERVAL_MAX	10000
+
+enum BMP280_MODE {
+	SLEEP = 0x00,
+	FORCED = 0x01,
+	NORMAL = 0x02
+};
+
+enum BMP280_OSRS {
+	OSRS_SKIPPED = 0x00,
+	OSRS_x1 = 0x01,
+	OSRS_x2 = 0x02,
+	OSRS_x4 = 0x03,
+	OSRS_x8 = 0x04,
+	OSRS_x16 = 0x05
+};
+
+enum BMP280_T_SB {
+	T_SB_0_5 = 0x00,
+	T_SB_62_5 = 0x01,
+	T_SB_125 = 0x02,
+	T_SB_250 = 0x03,
+	T_SB_500 = 0x04,
+	T_SB_1000 = 0x05,
+	T_SB_2000 = 0x06,
+	T_SB_4000 = 0x07
+};
+
+enum BMP280_FILTER {
+	FILTER_OFF = 0x00,
+	FILTER_2 = 0x01,
+	FILTER_4 = 0x02,
+	FILTER_8 = 0x03,
+	FILTER_16 = 0x04
+};
+
+// Standby times in microseconds, indexed by enum BMP280_T_SB
+static const unsigned int t_sb_us[] = {
+	500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000
+};
+
+// IIR filter coefficients, indexed by enum BMP280_FILTER
+static const unsigned int filter_coeffs[] = { 0, 2, 4, 8, 16 };
+
+static struct class *bmp280_class;
+static dev_t bmp280_devt; // first of the BMP280_MAX_DEVICES minors
+static DEFINE_IDA(bmp280_ida);
+
+static bool wait_data_ready = true;
+module_param(wait_data_ready, bool, 0644);
+MODULE_PARM_DESC(wait_data_ready,
+		 "Poll the measuring bit instead of sleeping the max measurement time");
+
+/**
+ * For the config register
+ */
+union bmp280_config {
+	struct {
+		u8 spi3w_en: 1;
+		u8: 1; // Reserved
+		u8 filter: 3;
+		u8 t_sb: 3;
+	} bits;
+	u8 byte;
+};
+
+/**
+ * For the ctrl_meas register
+ */
+union bmp280_ctrl_meas {
+	struct {
+		u8 mode: 2;
+		u8 osrs_p: 3;
+		u8 osrs_t: 3;
+	} bits;
+	u8 byte;
+};
+
+/**
+ * For the status register
+ */
+union bmp280_status {
+	struct {
+		u8 im_update: 1;
+		u8: 2; // Reserved
+		u8 measuring: 1;
+		u8: 4; // Reserved
+	} bits;
+	u8 byte;
+};
+
+/**
+ * Data struct for bmp280_data.
+ * Set as drvdata of both the i2c client and the bmp280N device, for having
+ * device data that is accessible in probe, remove and the sysfs attributes.
+ *
+ * It is owned by dev, and freed by its release once remove has run and every
+ * open file of the chardev is closed, since the cdev holds a reference to dev.
+ * After remove, gone is set and open files only fail with ENODEV.
+ *
+ * Temperature in millidegrees celsius
+ * Pressure in pascals
+ *
+ * Raw samples are read by the polling core, which polls every sensor on the
+ * same i2c adapter from one work item so their transactions don't interleave.
+ * They wait in the core's fifo until compensate_raw takes them out.
+ *
+ * record_fifo is filled by compensate_raw and emptied by chardev reads. Each
+ * record is read once, even with several readers.
+ *
+ * Events (sysfs_notify and chardev records) are only sent for samples that
+ * moved more than temperature_threshold or pressure_threshold away from the
+ * last event's values, and no more often than event_interval_min. A threshold
+ * of -1 turns events of that value off, and with both off every sample is
+ * queued as a record instead.
+ */
+struct bmp280_data {
+	struct i2c_client *client;
+	struct regmap *regmap;
+	struct device dev; // the bmp280N class device
+	struct bmp280_calib_data calib;
+	struct sensor_poll poll;
+	ktime_t meas_start; // when the current forced measurement started
+	// Set while runtime suspended, written under lock. Polling is paused
+	// while it is set
+	bool suspended;
+	bool stale; // no sample read since resuming
+	struct work_struct compensate_work;
+	struct mutex lock; // protects config, ctrl_meas and sensor access
+	struct mutex raw_lock; // serializes compensate_raw
+	spinlock_t record_lock; // protects record_fifo
+	DECLARE_KFIFO(record_fifo, struct bmp280_record, RECORD_FIFO_SIZE);
+	wait_queue_head_t record_wait;
+	atomic_t readers; // open chardev files, changed under open_lock
+	// protects gone and the PM references of readers and events
+	struct mutex open_lock;
+	bool gone; // set by remove
+	bool events_pm; // a PM reference is held while events are on
+	struct cdev cdev;
+	union bmp280_config config;
+	union bmp280_ctrl_meas ctrl_meas;
+	union bmp280_status status;
+	atomic_t temperature, pressure;
+	atomic_t temperature_threshold, pressure_threshold, event_interval_min;
+	atomic_t temperature_hysteresis, pressure_hysteresis;
+	// Values of the last event, protected by raw_lock
+	struct bmp280_sample last_event;
+	int temperature_dir, pressure_dir; // of the last change, -1, 0 or 1
+	ktime_t last_event_time;
+	bool event_sent;
+};
+
+static bool bmp280_readable_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_CALIB_START ... REG_CALIB_END:
+	case REG_ID:
+	case REG_STATUS:
+	case REG_CTRL_MEAS:
+	case REG_CONFIG:
+	case REG_PRESS ... REG_DATA_END:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool bmp280_writeable_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_RESET:
+	case REG_CTRL_MEAS:
+	case REG_CONFIG:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Only config, ctrl_meas, id and calibration data are cached
+static bool bmp280_volatile_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_RESET:
+	case REG_STATUS:
+	case REG_PRESS ... REG_DATA_END:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static const struct regmap_config bmp280_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = REG_DATA_END,
+	.readable_reg = bmp280_readable_reg,
+	.writeable_reg = bmp280_writeable_reg,
+	.volatile_reg = bmp280_volatile_reg,
+	.cache_type = REGCACHE_MAPLE,
+};
+
+// Takes the first (lsb) byte and converts into a word
+static inline u16 get_u16_le(const u8 *reg)
+{
+	return (reg[1] << 8) | reg[0];
+}
+
+// Takes the first (lsb) byte and converts into a word
+static inline s16 get_s16_le(const u8 *reg)
+{
+	return (s16)((reg[1] << 8) | reg[0]);
+}
+
+// Takes the register and combines the next three bytes into a u32 (uses 20bits)
+// used for getting adc_t or adc_p variable from register values
+static inline u32 reg_to_adc(const u8 *reg)
+{
+	return (reg[0] << 12) | (reg[1] << 4) | (reg[2] >> 4);
+}
+
+// Reads the status register into status
+static int read_status(struct bmp280_data *data, union bmp280_status *status)
+{
+	unsigned int val;
+	int ret;
+
+	ret = regmap_read(data->regmap, REG_STATUS, &val);
+	if (ret < 0) {
+		pr_err("bmp280: i2c read status failure\n");
+		return ret;
+	}
+
+	status->byte = val;
+
+	return 0;
+}
+
+/*
+ * Reads data from registers into raw
+ *
+ * Pressure and temperature are read in a single burst so both come from the
+ * same measurement (3.9 of the datasheet). Compensation is left to
+ * compensate_raw, so this only does bus I/O.
+ */
+static int full_read(struct bmp280_data *data, struct bmp280_raw_sample *raw)
+{
+	u8 data_buf[REG_PRESS_LEN + REG_TEMP_LEN];
+	int ret;
+
+	ret = regmap_bulk_read(data->regmap, REG_PRESS, data_buf,
+			       sizeof(data_buf));
+	if (ret < 0) {
+		trace_bmp280_full_read(&data->client->dev, 0, 0, ret);
+		pr_err("bmp280: i2c read data failure\n");
+		return ret;
+	}
+
+	raw->adc_t = reg_to_adc(&data_buf[REG_PRESS_LEN]);
+	raw->adc_p = reg_to_adc(data_buf);
+	trace_bmp280_full_read(&data->client->dev, raw->adc_t, raw->adc_p, 0);
+	data->stale = false;
+
+	read_status(data, &data->status);
+
+	return 0;
+}
+
+// Queues a record for chardev readers, dropping the oldest if full
+static void push_record(struct bmp280_data *data,
+			const struct bmp280_raw_sample *raw,
+			const struct bmp280_sample *sample)
+{
+	struct bmp280_record record = {
+		.timestamp = raw->timestamp,
+		.temperature = sample->temperature,
+		.pressure = sample->pressure,
+	};
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->record_lock, flags);
+
+	if (kfifo_is_full(&data->record_fifo))
+		kfifo_skip(&data->record_fifo);
+
+	kfifo_put(&data->record_fifo, record);
+
+	spin_unlock_irqrestore(&data->record_lock, flags);
+}
+
+// Whether either value has events on, see check_event
+static bool events_on(struct bmp280_data *data)
+{
+	return atomic_read(&data->temperature_threshold) >= 0 ||
+	       atomic_read(&data->pressure_threshold) >= 0;
+}
+
+/*
+ * Checks whether a value moved delta away from its last event's value by more
+ * than threshold. A threshold of 0 takes every sample, and -1 none.
+ *
+ * A move against the direction of the value's last event also has to clear
+ * hysteresis, so noise around one level doesn't send events both ways.
+ * Stores the direction of the move in new_dir.
+ */
+static bool value_changed(s64 delta, int threshold, int hysteresis, int dir,
+			  int *new_dir)
+{
+	s64 needed = threshold;
+
+	*new_dir = delta > 0 ? 1 : (delta < 0 ? -1 : 0);
+
+	if (threshold <= 0)
+		return threshold == 0;
+
+	if (*new_dir && *new_dir == -dir)
+		needed += hysteresis;
+
+	return abs(delta) > needed;
+}
+
+/*
+ * Checks whether a sample should be sent as an event, and if so records it as
+ * the last event of the values that changed. Sets temp_changed/press_changed
+ * for the values that crossed their threshold.
+ *
+ * The thresholds apply to the last event's values rather than the previous
+ * sample, so noise within the threshold never builds up into an event.
+ */
+static bool check_event(struct bmp280_data *data, u64 timestamp,
+			const struct bmp280_sample *sample, bool *temp_changed,
+			bool *press_changed)
+{
+	int temp_threshold = atomic_read(&data->temperature_threshold);
+	int press_threshold = atomic_read(&data->pressure_threshold);
+	int temp_hysteresis = atomic_read(&data->temperature_hysteresis);
+	int press_hysteresis = atomic_read(&data->pressure_hysteresis);
+	int interval_ms = atomic_read(&data->event_interval_min);
+	ktime_t time = ns_to_ktime(timestamp);
+	int temp_dir = 0, press_dir = 0;
+
+	if (data->event_sent) {
+		*temp_changed = value_changed((s64)sample->temperature -
+					      data->last_event.temperature,
+					      temp_threshold, temp_hysteresis,
+					      data->temperature_dir, &temp_dir);
+		*press_changed = value_changed((s64)sample->pressure -
+					       data->last_event.pressure,
+					       press_threshold, press_hysteresis,
+					       data->pressure_dir, &press_dir);
+
+		if (!*temp_changed && !*press_changed)
+			return false;
+
+		if (ktime_before(time, ktime_add_ms(data->last_event_time,
+						    interval_ms)))
+			return false;
+	} else {
+		*temp_changed = temp_threshold >= 0;
+		*press_changed = press_threshold >= 0;
+	}
+
+	if (*temp_changed) {
+		data->last_event.temperature = sample->temperature;
+		data->temperature_dir = temp_dir;
+	}
+
+	if (*press_changed) {
+		data->last_event.pressure = sample->pressure;
+		data->pressure_dir = press_dir;
+	}
+
+	data->last_event_time = time;
+	data->event_sent = true;
+
+	return true;
+}
+
+/*
+ * Compensates every captured raw sample in batches and stores the latest.
+ * Samples that pass check_event notify sysfs pollers and, while the chardev is
+ * open, are queued as records. With events off, every sample is queued.
+ */
+static void compensate_raw(struct bmp280_data *data)
+{
+	struct bmp280_raw_sample raw[RAW_BATCH_SIZE];
+	struct bmp280_sample samples[RAW_BATCH_SIZE];
+	bool temp_changed, press_changed;
+	bool temp_event = false, press_event = false, pushed = false;
+	bool events = events_on(data);
+	unsigned int count, i;
+
+	mutex_lock(&data->raw_lock);
+
+	while ((count = sensor_poll_out(&data->poll, raw, RAW_BATCH_SIZE))) {
+		bmp280_compensate_batch(&data->calib, raw, samples, count);
+
+		atomic_set(&data->temperature, samples[count - 1].temperature);
+		atomic_set(&data->pressure, samples[count - 1].pressure);
+
+		for (i = 0; i < count; i++) {
+			if (events) {
+				if (!check_event(data, raw[i].timestamp,
+						 &samples[i], &temp_changed,
+						 &press_changed))
+					continue;
+
+				temp_event |= temp_changed;
+				press_event |= press_changed;
+			}
+
+			if (atomic_read(&data->readers)) {
+				push_record(data, &raw[i], &samples[i]);
+				pushed = true;
+			}
+		}
+	}
+
+	mutex_unlock(&data->raw_lock);
+
+	if (pushed)
+		wake_up_interruptible(&data->record_wait);
+
+	if (temp_event)
+		sysfs_notify(&data->dev.kobj, NULL, "temperature");
+
+	if (press_event)
+		sysfs_notify(&data->dev.kobj, NULL, "pressure");
+}
+
+static void compensate_work(struct work_struct *workqueue)
+{
+	struct bmp280_data *data = container_of(workqueue, struct bmp280_data,
+						compensate_work);
+
+	compensate_raw(data);
+}
+
+// Writes ctrl_meas. In FORCED mode this starts a measurement
+static int write_ctrl_meas(struct bmp280_data *data, u8 ctrl_meas)
+{
+	int ret;
+
+	// Not regmap_update_bits, since the sensor clears FORCED by itself
+	// and the cached value would skip the write
+	ret = regmap_write(data->regmap, REG_CTRL_MEAS, ctrl_meas);
+	if (ret < 0) {
+		pr_err("bmp280: i2c write to ctrl_meas failure\n");
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes data from data variables into registers
+ *
+ * Writes are checked against the register cache, so registers that haven't
+ * changed aren't written again.
+ *
+ * Writes to config may be ignored in NORMAL mode (5.4.6 of the datasheet), so
+ * a running sensor is put to sleep before config is written. ctrl_meas is then
+ * only written back in NORMAL mode, since in FORCED mode bmp280_poll_trigger
+ * starts each measurement itself.
+ *
+ * While runtime suspended nothing is written, and the resume applies the
+ * config instead.
+ */
+static int full_write(struct bmp280_data *data)
+{
+	union bmp280_ctrl_meas sleep = data->ctrl_meas;
+	unsigned int cur_config, cur_ctrl_meas;
+	bool running;
+	int ret;
+
+	if (data->suspended)
+		return 0;
+
+	trace_bmp280_full_write(&data->client->dev, data->config.byte,
+				data->ctrl_meas.byte);
+
+	// Both are served from the cache
+	ret = regmap_read(data->regmap, REG_CONFIG, &cur_config);
+	if (ret < 0)
+		goto read_err;
+
+	ret = regmap_read(data->regmap, REG_CTRL_MEAS, &cur_ctrl_meas);
+	if (ret < 0)
+		goto read_err;
+
+	running = (cur_ctrl_meas & CTRL_MEAS_MODE_MASK) == NORMAL;
+
+	if (running && (cur_config != data->config.byte ||
+			data->ctrl_meas.bits.mode != NORMAL)) {
+		sleep.bits.mode = SLEEP;
+		ret = write_ctrl_meas(data, sleep.byte);
+		if (ret)
+			return ret;
+	}
+
+	ret = regmap_update_bits(data->regmap, REG_CONFIG, 0xFF,
+				 data->config.byte);
+	if (ret < 0) {
+		pr_err("bmp280: i2c write to config failure\n");
+		return ret;
+	}
+
+	if (data->ctrl_meas.bits.mode != NORMAL)
+		return 0;
+
+	ret = regmap_update_bits(data->regmap, REG_CTRL_MEAS, 0xFF,
+				 data->ctrl_meas.byte);
+	if (ret < 0) {
+		pr_err("bmp280: i2c write to ctrl_meas failure\n");
+		return ret;
+	}
+
+	return 0;
+
+read_err:
+	pr_err("bmp280: register cache read failure\n");
+	return ret;
+}
+
+// Initializes calibration data
+static int init_calib_data(struct bmp280_data *data)
+{
+	u8 calib_buf[REG_CALIB_LEN];
+	int ret;
+
+	ret = regmap_bulk_read(data->regmap, REG_CALIB_START, calib_buf,
+			       REG_CALIB_LEN);
+	if (ret < 0) {
+		pr_err("bmp280: i2c calibration value read failure\n");
+		return ret;
+	}
+
+	// Parsing registers into correct calibration variables
+	data->calib.t1 = get_u16_le(&calib_buf[0]);
+	data->calib.t2 = get_s16_le(&calib_buf[2]);
+	data->calib.t3 = get_s16_le(&calib_buf[4]);
+	data->calib.p1 = get_u16_le(&calib_buf[6]);
+	data->calib.p2 = get_s16_le(&calib_buf[8]);
+	data->calib.p3 = get_s16_le(&calib_buf[10]);
+	data->calib.p4 = get_s16_le(&calib_buf[12]);
+	data->calib.p5 = get_s16_le(&calib_buf[14]);
+	data->calib.p6 = get_s16_le(&calib_buf[16]);
+	data->calib.p7 = get_s16_le(&calib_buf[18]);
+	data->calib.p8 = get_s16_le(&calib_buf[20]);
+	data->calib.p9 = get_s16_le(&calib_buf[22]);
+
+	return 0;
+}
+
+// Initializes config data
+// These are the defaults, which can be changed through the sysfs attributes
+static void init_config_data(struct bmp280_data *data)
+{
+	struct bmp280_raw_sample raw;
+	struct bmp280_sample sample;
+
+	mutex_lock(&data->lock);
+
+	// initial read of temperature/pressure
+	if (!full_read(data, &raw)) {
+		bmp280_compensate(&data->calib, raw.adc_t, raw.adc_p, &sample);
+		atomic_set(&data->temperature, sample.temperature);
+		atomic_set(&data->pressure, sample.pressure);
+	}
+
+	// Sets
+	data->ctrl_meas.bits.osrs_t = OSRS_x2;
+	data->ctrl_meas.bits.osrs_p = OSRS_x16;
+	data->ctrl_meas.bits.mode = FORCED;
+	data->config.bits.t_sb = T_SB_0_5;
+	data->config.bits.filter = FILTER_OFF;
+
+	// Initial write to apply above config data
+	full_write(data);
+
+	mutex_unlock(&data->lock);
+}
+
+// Converts an osrs_t/osrs_p field into its oversampling count
+static unsigned int osrs_to_count(u8 osrs)
+{
+	switch (osrs) {
+	case OSRS_SKIPPED:
+		return 0;
+	case OSRS_x1:
+		return 1;
+	case OSRS_x2:
+		return 2;
+	case OSRS_x4:
+		return 4;
+	case OSRS_x8:
+		return 8;
+	default: // 0x05 and above are all x16
+		return 16;
+	}
+}
+
+/*
+ * Measurement time from 3.8.1 of the datasheet for the given ctrl_meas, in
+ * microseconds. Returns the maximum time if max is set, otherwise the typical
+ * time.
+ */
+static unsigned int measurement_time_us(union bmp280_ctrl_meas ctrl_meas,
+					bool max)
+{
+	unsigned int osrs_t = osrs_to_count(ctrl_meas.bits.osrs_t);
+	unsigned int osrs_p = osrs_to_count(ctrl_meas.bits.osrs_p);
+	unsigned int time;
+
+	if (max) {
+		time = MEAS_TIME_BASE_MAX
+		       + MEAS_TIME_PER_OSRS_MAX * (osrs_t + osrs_p);
+		if (osrs_p)
+			time += MEAS_TIME_PRESS_MAX;
+	} else {
+		time = MEAS_TIME_BASE_TYP
+		       + MEAS_TIME_PER_OSRS_TYP * (osrs_t + osrs_p);
+		if (osrs_p)
+			time += MEAS_TIME_PRESS_TYP;
+	}
+
+	return time;
+}
+
+// Sleeps until us microseconds have passed since start
+static void sleep_until_us(ktime_t start, unsigned int us)
+{
+	s64 waited_us = ktime_us_delta(ktime_get(), start);
+
+	if (waited_us < us)
+		usleep_range(us - waited_us, us - waited_us + STATUS_POLL_US / 2);
+}
+
+/*
+ * Waits for a forced measurement with ctrl_meas started at start to complete.
+ * Time already spent since then, e.g. on other sensors, is not waited again.
+ *
+ * With wait_data_ready, sleeps until the typical measurement time and then
+ * polls the measuring bit until it clears, giving up at the maximum
+ * measurement time. Otherwise just sleeps until the maximum measurement time.
+ *
+ * Called without data->lock, so sysfs stores aren't held up by the wait. Only
+ * the volatile status register is read, which regmap serializes on its own.
+ */
+static void wait_measurement(struct bmp280_data *data,
+			     union bmp280_ctrl_meas ctrl_meas, ktime_t start)
+{
+	unsigned int max_us = measurement_time_us(ctrl_meas, true);
+	union bmp280_status status;
+
+	if (!wait_data_ready) {
+		sleep_until_us(start, max_us);
+		return;
+	}
+
+	sleep_until_us(start, measurement_time_us(ctrl_meas, false));
+
+	while (ktime_us_delta(ktime_get(), start) < max_us) {
+		if (read_status(data, &status))
+			break;
+
+		if (!status.bits.measuring)
+			return;
+
+		usleep_range(STATUS_POLL_US, STATUS_POLL_US + STATUS_POLL_US / 2);
+	}
+
+	// Status read failed or the sensor ran past the maximum, so sleep the
+	// remainder of the maximum measurement time before reading
+	sleep_until_us(start, max_us);
+}
+
+/*
+ * Resumes the sensor for a sysfs read. If it was suspended, waits for the
+ * first poll after resuming so the read isn't stale.
+ */
+static int bmp280_pm_get(struct bmp280_data *data)
+{
+	int ret;
+
+	ret = pm_runtime_resume_and_get(&data->client->dev);
+	if (ret < 0)
+		return ret;
+
+	if (READ_ONCE(data->stale))
+		sensor_poll_flush(&data->poll);
+
+	return 0;
+}
+
+static void bmp280_pm_put(struct bmp280_data *data)
+{
+	pm_runtime_mark_last_busy(&data->client->dev);
+	pm_runtime_put_autosuspend(&data->client->dev);
+}
+
+// Shows temperature in millidegrees celsiuses
+static ssize_t temperature_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = bmp280_pm_get(data);
+	if (ret)
+		return ret;
+
+	compensate_raw(data);
+	bmp280_pm_put(data);
+
+	return sprintf(buf, "%d\n", atomic_read(&data->temperature));
+}
+
+static DEVICE_ATTR_RO(temperature);
+
+// Shows pressure in pascals in "Q24.8" format
+static ssize_t pressure_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = bmp280_pm_get(data);
+	if (ret)
+		return ret;
+
+	compensate_raw(data);
+	bmp280_pm_put(data);
+
+	return sprintf(buf, "%d\n", atomic_read(&data->pressure));
+}
+
+static DEVICE_ATTR_RO(pressure);
+
+// Displays poll_interval in milliseconds
+static ssize_t poll_interval_show(struct device *dev,
+				  struct device_attribute *attr,
+				  char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return sprintf(buf, "%u\n", sensor_poll_interval(&data->poll));
+}
+
+// A poll can't be shorter than the time it takes to measure, which is 43.2ms
+// at most for ultra high resolution sampling
+static int min_poll_interval(union bmp280_ctrl_meas ctrl_meas)
+{
+	return max(POLL_INTERVAL_MIN,
+		   (int)DIV_ROUND_UP(measurement_time_us(ctrl_meas, true),
+				     USEC_PER_MSEC));
+}
+
+/*
+ * Accepts poll_intervals in milliseconds
+ * Range accepting is 5ms to 10000ms (10s), and no shorter than the maximum
+ * measurement time of the current oversampling settings
+ */
+
+static ssize_t poll_interval_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	int ret, new_poll_interval, min_interval;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = kstrtoint(buf, 10, &new_poll_interval);
+	if (ret < 0)
+		return ret;
+
+	// Ensures number isn't negative and is at most 10s.
+	if (new_poll_interval < 0) {
+		return -EINVAL;
+	} else if (new_poll_interval > POLL_INTERVAL_MAX) {
+		pr_err("bmp280: tried to assign poll_interval greater than 10s\n");
+		return -EINVAL;
+	}
+
+	// Held while setting, so the oversampling can't change in between
+	mutex_lock(&data->lock);
+
+	min_interval = min_poll_interval(data->ctrl_meas);
+	if (new_poll_interval < min_interval) {
+		mutex_unlock(&data->lock);
+		pr_err("bmp280: tried to assign poll_interval less than %dms\n",
+		       min_interval);
+		return -EINVAL;
+	}
+
+	// run once now, and then with the new interval
+	sensor_poll_set_interval(&data->poll, new_poll_interval);
+
+	mutex_unlock(&data->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(poll_interval);
+
+// Shows the sampling mode, either "forced" or "normal"
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	mutex_lock(&data->lock);
+	ret = sysfs_emit(buf, "%s\n",
+			 data->ctrl_meas.bits.mode == NORMAL ? "normal" : "forced");
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * Accepts "forced" or "normal"
+ *
+ * In forced mode every poll starts a measurement and waits for it. In normal
+ * mode the sensor measures continuously every t_sb, and polling only reads the
+ * data registers.
+ */
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	mutex_lock(&data->lock);
+
+	if (sysfs_streq(buf, "normal")) {
+		data->ctrl_meas.bits.mode = NORMAL;
+	} else if (sysfs_streq(buf, "forced")) {
+		data->ctrl_meas.bits.mode = FORCED;
+	} else {
+		mutex_unlock(&data->lock);
+		return -EINVAL;
+	}
+
+	ret = full_write(data);
+	mutex_unlock(&data->lock);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(mode);
+
+// Shows an oversampling field as its count (0 is skipped)
+static ssize_t show_osrs(struct device *dev, char *buf, bool pressure)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	mutex_lock(&data->lock);
+	ret = sysfs_emit(buf, "%u\n",
+			 osrs_to_count(pressure ? data->ctrl_meas.bits.osrs_p
+						: data->ctrl_meas.bits.osrs_t));
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+// Accepts oversampling counts of 0 (skipped), 1, 2, 4, 8 or 16
+static ssize_t store_osrs(struct device *dev, const char *buf, size_t count,
+			  bool pressure)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret, min_interval;
+	u8 osrs;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	for (osrs = OSRS_SKIPPED; osrs <= OSRS_x16; osrs++)
+		if (osrs_to_count(osrs) == val)
+			break;
+
+	if (osrs > OSRS_x16)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+
+	if (pressure)
+		data->ctrl_meas.bits.osrs_p = osrs;
+	else
+		data->ctrl_meas.bits.osrs_t = osrs;
+
+	ret = full_write(data);
+	if (ret)
+		goto unlock;
+
+	// Longer measurements raise the interval, so polls don't overlap them
+	min_interval = min_poll_interval(data->ctrl_meas);
+	if (sensor_poll_interval(&data->poll) < min_interval) {
+		pr_info("bmp280: raised poll_interval to %dms\n", min_interval);
+		sensor_poll_set_interval(&data->poll, min_interval);
+	}
+
+unlock:
+	mutex_unlock(&data->lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t oversampling_temperature_show(struct device *dev,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	return show_osrs(dev, buf, false);
+}
+
+static ssize_t oversampling_temperature_store(struct device *dev,
+					      struct device_attribute *attr,
+					      const char *buf, size_t count)
+{
+	return store_osrs(dev, buf, count, false);
+}
+
+static DEVICE_ATTR_RW(oversampling_temperature);
+
+static ssize_t oversampling_pressure_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	return show_osrs(dev, buf, true);
+}
+
+static ssize_t oversampling_pressure_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	return store_osrs(dev, buf, count, true);
+}
+
+static DEVICE_ATTR_RW(oversampling_pressure);
+
+// Shows the IIR filter coefficient (0 is off)
+static ssize_t filter_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	unsigned int filter;
+
+	if (!data)
+		return -ENODEV;
+
+	mutex_lock(&data->lock);
+	filter = min_t(unsigned int, data->config.bits.filter, FILTER_16);
+	mutex_unlock(&data->lock);
+
+	return sysfs_emit(buf, "%u\n", filter_coeffs[filter]);
+}
+
+// Accepts IIR filter coefficients of 0 (off), 2, 4, 8 or 16
+static ssize_t filter_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	unsigned int val, i;
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(filter_coeffs); i++)
+		if (filter_coeffs[i] == val)
+			break;
+
+	if (i == ARRAY_SIZE(filter_coeffs))
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+	data->config.bits.filter = i;
+	ret = full_write(data);
+	mutex_unlock(&data->lock);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(filter);
+
+// Shows the normal mode standby time in microseconds
+static ssize_t standby_time_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	unsigned int t_sb;
+
+	if (!data)
+		return -ENODEV;
+
+	mutex_lock(&data->lock);
+	t_sb = data->config.bits.t_sb;
+	mutex_unlock(&data->lock);
+
+	return sysfs_emit(buf, "%u\n", t_sb_us[t_sb]);
+}
+
+/*
+ * Accepts normal mode standby times in microseconds
+ * Valid values are 500, 62500, 125000, 250000, 500000, 1000000, 2000000 and
+ * 4000000
+ */
+static ssize_t standby_time_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	unsigned int val, i;
+	int ret;
+
+	if (!data)
+		return -ENODEV;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(t_sb_us); i++)
+		if (t_sb_us[i] == val)
+			break;
+
+	if (i == ARRAY_SIZE(t_sb_us))
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+	data->config.bits.t_sb = i;
+	ret = full_write(data);
+	mutex_unlock(&data->lock);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(standby_time);
+
+// Shows an event setting
+static ssize_t show_event_setting(char *buf, atomic_t *setting)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(setting));
+}
+
+// Accepts a non-negative event setting
+static ssize_t store_event_setting(const char *buf, size_t count,
+				   atomic_t *setting)
+{
+	int ret, val;
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	if (val < 0)
+		return -EINVAL;
+
+	atomic_set(setting, val);
+
+	return count;
+}
+
+/*
+ * Takes or drops the PM reference of events so it matches events_on. Sysfs
+ * pollers hold no reference of their own, so without it polling, and with it
+ * the events, would stop once the sensor autosuspends.
+ *
+ * Called with open_lock held.
+ */
+static int update_events_pm(struct bmp280_data *data)
+{
+	bool on = events_on(data);
+	int ret;
+
+	if (data->gone || on == data->events_pm)
+		return 0;
+
+	if (on) {
+		ret = pm_runtime_resume_and_get(&data->client->dev);
+		if (ret < 0)
+			return ret;
+	} else {
+		pm_runtime_mark_last_busy(&data->client->dev);
+		pm_runtime_put_autosuspend(&data->client->dev);
+	}
+
+	data->events_pm = on;
+
+	return 0;
+}
+
+// Accepts a threshold of -1 (off) or more, resuming the sensor if needed
+static ssize_t store_threshold(struct bmp280_data *data, const char *buf,
+			       size_t count, atomic_t *threshold)
+{
+	int ret, val, old;
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	if (val < -1)
+		return -EINVAL;
+
+	mutex_lock(&data->open_lock);
+
+	old = atomic_xchg(threshold, val);
+	ret = update_events_pm(data);
+	if (ret)
+		atomic_set(threshold, old);
+
+	mutex_unlock(&data->open_lock);
+
+	return ret ? ret : count;
+}
+
+/*
+ * Change in millidegrees celsius needed for a temperature event. 0 sends every
+ * sample, -1 turns temperature events off
+ */
+static ssize_t temperature_threshold_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return show_event_setting(buf, &data->temperature_threshold);
+}
+
+static ssize_t temperature_threshold_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return store_threshold(data, buf, count, &data->temperature_threshold);
+}
+
+static DEVICE_ATTR_RW(temperature_threshold);
+
+/*
+ * Change in "Q24.8" pascals needed for a pressure event. 0 sends every sample,
+ * -1 turns pressure events off
+ */
+static ssize_t pressure_threshold_show(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return show_event_setting(buf, &data->pressure_threshold);
+}
+
+static ssize_t pressure_threshold_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return store_threshold(data, buf, count, &data->pressure_threshold);
+}
+
+static DEVICE_ATTR_RW(pressure_threshold);
+
+// Minimum time between events in milliseconds
+static ssize_t event_interval_min_show(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return show_event_setting(buf, &data->event_interval_min);
+}
+
+static ssize_t event_interval_min_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return store_event_setting(buf, count, &data->event_interval_min);
+}
+
+static DEVICE_ATTR_RW(event_interval_min);
+
+// Extra change in millidegrees celsius needed for a temperature event that
+// reverses the direction of the last one
+static ssize_t temperature_hysteresis_show(struct device *dev,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return show_event_setting(buf, &data->temperature_hysteresis);
+}
+
+static ssize_t temperature_hysteresis_store(struct device *dev,
+					    struct device_attribute *attr,
+					    const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return store_event_setting(buf, count, &data->temperature_hysteresis);
+}
+
+static DEVICE_ATTR_RW(temperature_hysteresis);
+
+// Extra change in "Q24.8" pascals needed for a pressure event that reverses
+// the direction of the last one
+static ssize_t pressure_hysteresis_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return show_event_setting(buf, &data->pressure_hysteresis);
+}
+
+static ssize_t pressure_hysteresis_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+
+	if (!data)
+		return -ENODEV;
+
+	return store_event_setting(buf, count, &data->pressure_hysteresis);
+}
+
+static DEVICE_ATTR_RW(pressure_hysteresis);
+
+static struct attribute *bmp280_attrs[] = {
+	&dev_attr_temperature.attr,
+	&dev_attr_pressure.attr,
+	&dev_attr_poll_interval.attr,
+	&dev_attr_mode.attr,
+	&dev_attr_oversampling_temperature.attr,
+	&dev_attr_oversampling_pressure.attr,
+	&dev_attr_filter.attr,
+	&dev_attr_standby_time.attr,
+	&dev_attr_temperature_threshold.attr,
+	&dev_attr_pressure_threshold.attr,
+	&dev_attr_event_interval_min.attr,
+	&dev_attr_temperature_hysteresis.attr,
+	&dev_attr_pressure_hysteresis.attr,
+	NULL
+};
+
+// Added and removed with the device, so they exist before its uevent
+ATTRIBUTE_GROUPS(bmp280);
+
+static int bmp280_cdev_open(struct inode *inode, struct file *file)
+{
+	struct bmp280_data *data = container_of(inode->i_cdev,
+						struct bmp280_data, cdev);
+	int ret;
+
+	mutex_lock(&data->open_lock);
+
+	if (data->gone) {
+		ret = -ENODEV;
+		goto unlock;
+	}
+
+	// Keeps the sensor polling for as long as the file is open
+	ret = pm_runtime_resume_and_get(&data->client->dev);
+	if (ret < 0)
+		goto unlock;
+
+	file->private_data = data;
+	atomic_inc(&data->readers);
+	ret = stream_open(inode, file);
+
+unlock:
+	mutex_unlock(&data->open_lock);
+
+	return ret;
+}
+
+static int bmp280_cdev_release(struct inode *inode, struct file *file)
+{
+	struct bmp280_data *data = file->private_data;
+	unsigned long flags;
+
+	mutex_lock(&data->open_lock);
+
+	// Nobody is left to read the queued records
+	if (atomic_dec_and_test(&data->readers)) {
+		spin_lock_irqsave(&data->record_lock, flags);
+		kfifo_reset(&data->record_fifo);
+		spin_unlock_irqrestore(&data->record_lock, flags);
+	}
+
+	// remove already dropped the PM reference of the file
+	if (!data->gone) {
+		pm_runtime_mark_last_busy(&data->client->dev);
+		pm_runtime_put_autosuspend(&data->client->dev);
+	}
+
+	mutex_unlock(&data->open_lock);
+
+	return 0;
+}
+
+/*
+ * Reads as many whole struct bmp280_record as fit in count
+ *
+ * Blocks until at least one record is queued, unless the file is O_NONBLOCK.
+ * Fails with ENODEV once the sensor is removed.
+ */
+static ssize_t bmp280_cdev_read(struct file *file, char __user *buf,
+				size_t count, loff_t *pos)
+{
+	struct bmp280_data *data = file->private_data;
+	struct bmp280_record records[READ_BATCH_SIZE];
+	unsigned int n;
+	int ret;
+
+	if (count < sizeof(records[0]))
+		return -EINVAL;
+
+	n = min_t(size_t, count / sizeof(records[0]), READ_BATCH_SIZE);
+
+	for (;;) {
+		if (READ_ONCE(data->gone))
+			return -ENODEV;
+
+		n = kfifo_out_spinlocked(&data->record_fifo, records, n,
+					 &data->record_lock);
+		if (n)
+			break;
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(data->record_wait,
+					       !kfifo_is_empty(&data->record_fifo) ||
+					       READ_ONCE(data->gone));
+		if (ret)
+			return ret;
+
+		n = min_t(size_t, count / sizeof(records[0]), READ_BATCH_SIZE);
+	}
+
+	if (copy_to_user(buf, records, n * sizeof(records[0])))
+		return -EFAULT;
+
+	return n * sizeof(records[0]);
+}
+
+static __poll_t bmp280_cdev_poll(struct file *file, poll_table *wait)
+{
+	struct bmp280_data *data = file->private_data;
+
+	poll_wait(file, &data->record_wait, wait);
+
+	if (READ_ONCE(data->gone))
+		return EPOLLHUP | EPOLLERR;
+
+	if (!kfifo_is_empty(&data->record_fifo))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static const struct file_operations bmp280_cdev_ops = {
+	.owner = THIS_MODULE,
+	.open = bmp280_cdev_open,
+	.release = bmp280_cdev_release,
+	.read = bmp280_cdev_read,
+	.poll = bmp280_cdev_poll,
+};
+
+// Starts a measurement in FORCED mode. NORMAL mode measures on its own
+static int bmp280_poll_trigger(struct sensor_poll *poll)
+{
+	struct bmp280_data *data = container_of(poll, struct bmp280_data, poll);
+	int ret = 0;
+
+	mutex_lock(&data->lock);
+
+	if (data->ctrl_meas.bits.mode == FORCED) {
+		data->meas_start = ktime_get();
+		ret = write_ctrl_meas(data, data->ctrl_meas.byte);
+	}
+
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * The measurement is waited for without data->lock. A config written in the
+ * meantime only applies from the next measurement, which is started by the
+ * next trigger.
+ */
+static int bmp280_poll_read(struct sensor_poll *poll, void *record)
+{
+	struct bmp280_data *data = container_of(poll, struct bmp280_data, poll);
+	union bmp280_ctrl_meas ctrl_meas;
+	ktime_t start;
+	int ret;
+
+	mutex_lock(&data->lock);
+	ctrl_meas = data->ctrl_meas;
+	start = data->meas_start;
+	mutex_unlock(&data->lock);
+
+	if (ctrl_meas.bits.mode == FORCED)
+		wait_measurement(data, ctrl_meas, start);
+
+	mutex_lock(&data->lock);
+	ret = full_read(data, record);
+
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * Chardev readers and events need every sample checked as it arrives, so
+ * samples are only batched without them. Events are then sent per sample
+ * rather than in bursts of a batch.
+ */
+static void bmp280_poll_notify(struct sensor_poll *poll)
+{
+	struct bmp280_data *data = container_of(poll, struct bmp280_data, poll);
+
+	if (sensor_poll_len(poll) >= RAW_BATCH_SIZE ||
+	    atomic_read(&data->readers) || events_on(data))
+		schedule_work(&data->compensate_work);
+}
+
+static const struct sensor_poll_ops bmp280_poll_ops = {
+	.trigger = bmp280_poll_trigger,
+	.read = bmp280_poll_read,
+	.notify = bmp280_poll_notify,
+};
+
+/*
+ * Takes the sensor out of polling and puts it to sleep. With every sensor on a
+ * bus suspended, the bus timer is no longer armed.
+ */
+static int bmp280_runtime_suspend(struct device *dev)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	union bmp280_ctrl_meas sleep;
+	int ret;
+
+	// No poll of the sensor is running once this returns
+	sensor_poll_pause(&data->poll);
+
+	mutex_lock(&data->lock);
+
+	sleep = data->ctrl_meas;
+	sleep.bits.mode = SLEEP;
+	ret = regmap_update_bits(data->regmap, REG_CTRL_MEAS, 0xFF, sleep.byte);
+	if (!ret)
+		data->suspended = true;
+
+	mutex_unlock(&data->lock);
+
+	if (ret)
+		sensor_poll_resume(&data->poll);
+
+	return ret;
+}
+
+// Applies the config again and polls straight away
+static int bmp280_runtime_resume(struct device *dev)
+{
+	struct bmp280_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	data->suspended = false;
+	ret = full_write(data);
+	if (ret)
+		data->suspended = true;
+	else
+		data->stale = true;
+
+	mutex_unlock(&data->lock);
+
+	if (!ret)
+		sensor_poll_resume(&data->poll);
+
+	return ret;
+}
+
+static DEFINE_RUNTIME_DEV_PM_OPS(bmp280_pm_ops, bmp280_runtime_suspend,
+				 bmp280_runtime_resume, NULL);
+
+// Frees data once remove has run and every open file is closed
+static void bmp280_dev_release(struct device *dev)
+{
+	kfree(container_of(dev, struct bmp280_data, dev));
+}
+
+/*
+ * Open files keep data alive after remove, but not the sensor. They give up
+ * their runtime PM references here, and blocked readers are woken to fail
+ * with ENODEV.
+ */
+static void bmp280_disconnect(struct bmp280_data *data)
+{
+	int readers;
+
+	mutex_lock(&data->open_lock);
+
+	WRITE_ONCE(data->gone, true);
+	for (readers = atomic_read(&data->readers); readers > 0; readers--)
+		pm_runtime_put_noidle(&data->client->dev);
+
+	if (data->events_pm)
+		pm_runtime_put_noidle(&data->client->dev);
+
+	mutex_unlock(&data->open_lock);
+
+	wake_up_interruptible_all(&data->record_wait);
+}
+
+static int bmp280_probe(struct i2c_client *client)
+{
+	struct bmp280_data *data;
+	int ret;
+
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	data->client = client;
+	mutex_init(&data->lock);
+	mutex_init(&data->raw_lock);
+	mutex_init(&data->open_lock);
+	INIT_WORK(&data->compensate_work, compensate_work);
+	spin_lock_init(&data->record_lock);
+	INIT_KFIFO(data->record_fifo);
+	init_waitqueue_head(&data->record_wait);
+	atomic_set(&data->temperature_threshold, -1);
+	atomic_set(&data->pressure_threshold, -1);
+
+	// From here on data is freed by putting the device
+	device_initialize(&data->dev);
+	data->dev.class = bmp280_class;
+	data->dev.parent = &client->dev;
+	data->dev.release = bmp280_dev_release;
+	data->dev.groups = bmp280_groups;
+	dev_set_drvdata(&data->dev, data); // For accessing in sysfs attr
+
+	data->regmap = devm_regmap_init_i2c(client, &bmp280_regmap_config);
+	if (IS_ERR(data->regmap)) {
+		pr_err("bmp280: failed to init regmap\n");
+		ret = PTR_ERR(data->regmap);
+		goto put_dev;
+	}
+
+	// Sensors on the same adapter are polled together
+	ret = sensor_poll_init(&data->poll, &bmp280_poll_ops, client->adapter,
+			       sizeof(struct bmp280_raw_sample), RAW_FIFO_SIZE,
+			       1000);
+	if (ret)
+		goto put_dev;
+
+	// Takes a minor from the driver's range for the device
+	ret = ida_alloc_max(&bmp280_ida, BMP280_MAX_DEVICES - 1, GFP_KERNEL);
+	if (ret < 0) {
+		pr_err("bmp280: no free minor numbers\n");
+		goto ida_err;
+	}
+
+	data->dev.devt = MKDEV(MAJOR(bmp280_devt), ret);
+
+	ret = dev_set_name(&data->dev, "bmp280%d", MINOR(data->dev.devt));
+	if (ret)
+		goto calib_err;
+
+	dev_set_drvdata(&client->dev, data); // For accessing in .remove
+
+	ret = init_calib_data(data);
+	if (ret < 0)
+		goto calib_err;
+
+	init_config_data(data);
+
+	// The counters sit under the i2c device, since dev isn't added yet
+	ret = sensor_poll_start(&data->poll, &client->dev.kobj);
+	if (ret)
+		goto calib_err;
+
+	// The sensor is polling, so it starts active and suspends once no one
+	// has read it for AUTOSUSPEND_MS
+	pm_runtime_set_active(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev, AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	pm_runtime_enable(&client->dev);
+
+	/*
+	 * Last, so the node and its attributes only appear once opening it
+	 * can resume the sensor. The cdev holds a reference to dev while a
+	 * file of it is open
+	 */
+	cdev_init(&data->cdev, &bmp280_cdev_ops);
+	data->cdev.owner = THIS_MODULE;
+	ret = cdev_device_add(&data->cdev, &data->dev);
+	if (ret) {
+		pr_err("bmp280: failed to add device\n");
+		goto cdev_err;
+	}
+
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_idle(&client->dev);
+
+	pr_info("bmp280: device probed");
+
+	return 0;
+
+cdev_err:
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+	sensor_poll_stop(&data->poll);
+	cancel_work_sync(&data->compensate_work);
+calib_err:
+	ida_free(&bmp280_ida, MINOR(data->dev.devt));
+ida_err:
+	sensor_poll_free(&data->poll);
+put_dev:
+	put_device(&data->dev);
+	return ret;
+}
+
+static void bmp280_remove(struct i2c_client *client)
+{
+	// no error handling since return void???
+	struct bmp280_data *data = dev_get_drvdata(&client->dev);
+
+	bmp280_disconnect(data);
+
+	// Stops runtime PM first, since its callbacks use the polling
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+
+	// Removes the node and attributes. Open files keep data until closed
+	cdev_device_del(&data->cdev, &data->dev);
+	sensor_poll_stop(&data->poll);
+	cancel_work_sync(&data->compensate_work);
+	ida_free(&bmp280_ida, MINOR(data->dev.devt));
+	sensor_poll_free(&data->poll);
+
+	// data is freed now, or once the last open file is closed
+	put_device(&data->dev);
+
+	pr_info("bmp280: device removed");
+}
+
+static const struct i2c_device_id bmp280_id_table[] = {
+	{ "bmp280", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, bmp280_id_table);
+
+static const struct of_device_id bmp280_dt_ids[] = {
+	{ .compatible = "bosch, bmp280" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, bmp280_dt_ids);
+
+static struct i2c_driver bmp280_driver = {
+	.driver = {
+		.name = "bmp280",
+		.of_match_table = bmp280_dt_ids,
+		.pm = pm_ptr(&bmp280_pm_ops),
+	},
+	.probe = bmp280_probe,
+	.remove = bmp280_remove,
+	.id_table = bmp280_id_table,
+};
+
+static int __init bmp280_init(void)
+{
+	int ret;
+
+	ret = alloc_chrdev_region(&bmp280_devt, 0, BMP280_MAX_DEVICES,
+				  CLASS_NAME);
+	if (ret < 0) {
+		pr_err("bmp280: failed to allocate chrdev region\n");
+		return ret;
+	}
+
+	bmp280_class = class_create(CLASS_NAME);
+	if (IS_ERR(bmp280_class)) {
+		pr_err("bmp280: failed to create class\n");
+		ret = PTR_ERR(bmp280_class);
+		goto class_err;
+	}
+
+	ret = i2c_add_driver(&bmp280_driver);
+	if (ret)
+		goto driver_err;
+
+	pr_info("bmp280: driver initialized\n");
+
+	return 0;
+
+driver_err:
+	class_destroy(bmp280_class);
+class_err:
+	unregister_chrdev_region(bmp280_devt, BMP280_MAX_DEVICES);
+	return ret;
+}
+
+static void __exit bmp280_exit(void)
+{
+	i2c_del_driver(&bmp280_driver);
+	class_destroy(bmp280_class);
+	unregister_chrdev_region(bmp280_devt, BMP280_MAX_DEVICES);
+	pr_info("bmp280: driver exited\n");
+}
+
+module_init(bmp280_init);
+module_exit(bmp280_exit);
+
+MODULE_AUTHOR("Michael Harris <michaelharriscode@gmail.com>");
+MODULE_DESCRIPTION("Simple BMP280 driver");
+MODULE_LICENSE("GPL");
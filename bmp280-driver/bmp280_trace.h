@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for bmp280 register access
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bmp280
+
+#if !defined(BMP280_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define BMP280_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/device.h>
+
+// Raw ADC values of one burst read. Both are 0 if the read failed
+TRACE_EVENT(bmp280_full_read,
+	TP_PROTO(struct device *dev, s32 adc_t, s32 adc_p, int ret),
+	TP_ARGS(dev, adc_t, adc_p, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(s32, adc_t)
+		__field(s32, adc_p)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__entry->adc_t = adc_t;
+		__entry->adc_p = adc_p;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s adc_t=%d adc_p=%d ret=%d", __get_str(dev),
+		  __entry->adc_t, __entry->adc_p, __entry->ret)
+);
+
+// Register values being applied
+TRACE_EVENT(bmp280_full_write,
+	TP_PROTO(struct device *dev, u8 config, u8 ctrl_meas),
+	TP_ARGS(dev, config, ctrl_meas),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, config)
+		__field(u8, ctrl_meas)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__entry->config = config;
+		__entry->ctrl_meas = ctrl_meas;
+	),
+
+	TP_printk("%s config=0x%02x ctrl_meas=0x%02x", __get_str(dev),
+		  __entry->config, __entry->ctrl_meas)
+);
+
+#endif /* BMP280_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bmp280_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+ * Interface of the bmp280 character device shared with userspace
+ */
+
+#ifndef BMP280_UAPI_H
+#define BMP280_UAPI_H
+
+#include <linux/types.h>
+
+/**
+ * Binary record returned by reads of /dev/bmp280N
+ *
+ * Timestamp is CLOCK_MONOTONIC in nanoseconds, taken when the data registers
+ * were read. Temperature is in millidegrees celsius and pressure in pascals
+ * in a "Q24.8 format", the same units as the sysfs attributes.
+ */
+struct bmp280_record {
+	__u64 timestamp;
+	__s32 temperature;
+	__u32 pressure;
+};
+
+#endif /* BMP280_UAPI_H */
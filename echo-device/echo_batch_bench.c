@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Compares the batch ioctls of the echo device with per message read/write
+ *
+ * Both paths move the same number of messages through one priority queue.
+ * The read/write path does a write and a read per message. The batch path
+ * sends batch messages with ECHO_IOC_SEND_BATCH and receives them with
+ * ECHO_IOC_RECV_BATCH, so two syscalls and two queue lock acquisitions per
+ * batch. Build with `make bench`.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include "echo_uapi.h"
+
+#define DEFAULT_MESSAGES	1000000
+#define DEFAULT_BATCH		32
+#define DEFAULT_TAG		0xbe7c
+#define MSG_SIZE		64
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_rw(int fd, unsigned int messages, size_t size)
+{
+	char msg[MSG_SIZE], buf[MSG_SIZE];
+	unsigned int i;
+
+	memset(msg, 'a', size);
+
+	for (i = 0; i < messages; i++)
+		if (write(fd, msg, size) < 0 || read(fd, buf, sizeof(buf)) < 0)
+			return -errno;
+
+	return 0;
+}
+
+static int bench_batch(int fd, unsigned int messages, unsigned int batch,
+		       size_t size, uint32_t tag)
+{
+	struct echo_msg_desc descs[ECHO_BATCH_MAX];
+	char slots[ECHO_BATCH_MAX][MSG_SIZE];
+	struct echo_batch b = { .descs = (uintptr_t)descs };
+	unsigned int i, n, done;
+
+	memset(slots, 'a', sizeof(slots));
+
+	for (done = 0; done < messages; done += n) {
+		n = messages - done < batch ? messages - done : batch;
+
+		for (i = 0; i < n; i++)
+			descs[i] = (struct echo_msg_desc){
+				.addr = (uintptr_t)slots[i],
+				.len = size,
+				.tag = tag,
+			};
+		b.count = n;
+
+		if (ioctl(fd, ECHO_IOC_SEND_BATCH, &b) < 0)
+			return -errno;
+		if (b.done != n)
+			return descs[0].status ? descs[0].status : -EAGAIN;
+
+		for (i = 0; i < n; i++)
+			descs[i].len = MSG_SIZE;
+
+		if (ioctl(fd, ECHO_IOC_RECV_BATCH, &b) < 0)
+			return -errno;
+		if (b.done != n)
+			return -EIO;
+	}
+
+	return 0;
+}
+
+static void report(const char *name, unsigned int messages, uint64_t ns)
+{
+	printf("%-10s %10.0f msgs/s  %8.1f ns/msg\n", name,
+	       messages / (ns / 1e9), (double)ns / messages);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n messages] [-b batch] [-s size] [-t tag] device\n"
+		"  -t  tag of the queue to create and use, default 0x%x\n",
+		prog, DEFAULT_TAG);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int messages = DEFAULT_MESSAGES;
+	unsigned int batch = DEFAULT_BATCH;
+	size_t size = MSG_SIZE;
+	uint32_t tag = DEFAULT_TAG;
+	uint32_t mode = ECHO_READ_QUEUE;
+	struct echo_queue_attr attr;
+	uint64_t start;
+	int fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:b:s:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			messages = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tag = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || !messages || !batch ||
+	    batch > ECHO_BATCH_MAX || !size || size > MSG_SIZE || !tag) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	attr = (struct echo_queue_attr){
+		.tag = tag,
+		.depth = batch,
+	};
+	if (ioctl(fd, ECHO_IOC_QUEUE_CREATE, &attr) < 0 ||
+	    ioctl(fd, ECHO_IOC_SET_WRITE_QUEUE, &tag) < 0 ||
+	    ioctl(fd, ECHO_IOC_SET_READ_MODE, &mode) < 0) {
+		perror("queue setup");
+		return 1;
+	}
+
+	start = now_ns();
+	ret = bench_rw(fd, messages, size);
+	if (ret) {
+		fprintf(stderr, "read/write: %s\n", strerror(-ret));
+		goto out;
+	}
+	report("read/write", messages, now_ns() - start);
+
+	start = now_ns();
+	ret = bench_batch(fd, messages, batch, size, tag);
+	if (ret) {
+		fprintf(stderr, "batch: %s\n", strerror(-ret));
+		goto out;
+	}
+	report("batch", messages, now_ns() - start);
+
+out:
+	ioctl(fd, ECHO_IOC_QUEUE_DESTROY, &tag);
+	close(fd);
+
+	return ret ? 1 : 0;
+}
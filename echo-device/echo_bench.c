@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Userspace load generator for echo devices
+ *
+ * Each thread opens the device and repeatedly writes a message and reads it
+ * back, timing every write/read pair. Works with any device that echoes the
+ * last write, e.g. /dev/echo_device and the Rust version in
+ * ../rust-module-starter, so both can be run under the same load.
+ *
+ * -w only writes, and -a pins thread N to CPU N, which together show how
+ * writes scale with the shards module parameter.
+ *
+ * Build with `make bench`.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS	100000
+#define DEFAULT_SIZE		64
+#define MAX_SIZE		255 // the devices keep at most 255 bytes
+#define MAX_THREADS		64
+
+struct bench_thread {
+	pthread_t thread;
+	const char *path;
+	unsigned int iterations;
+	size_t size;
+	uint64_t *latency_ns; // one per iteration
+	int cpu; // to pin to, or -1
+	int write_only;
+	int err;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *bench_run(void *arg)
+{
+	struct bench_thread *t = arg;
+	char msg[MAX_SIZE + 1], buf[MAX_SIZE + 1];
+	uint64_t start;
+	unsigned int i;
+	int fd;
+
+	memset(msg, 'a', t->size);
+
+	if (t->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(t->cpu, &set);
+		t->err = pthread_setaffinity_np(pthread_self(), sizeof(set),
+						&set);
+		if (t->err)
+			return NULL;
+	}
+
+	fd = open(t->path, O_RDWR);
+	if (fd < 0) {
+		t->err = errno;
+		return NULL;
+	}
+
+	for (i = 0; i < t->iterations; i++) {
+		start = now_ns();
+
+		// Both at offset 0, so the file position never needs resetting
+		if (pwrite(fd, msg, t->size, 0) < 0 ||
+		    (!t->write_only && pread(fd, buf, sizeof(buf), 0) < 0)) {
+			t->err = errno;
+			break;
+		}
+
+		t->latency_ns[i] = now_ns() - start;
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n iterations] [-s size] [-t threads] [-a] [-w] device\n"
+		"  -a  pin thread N to CPU N\n"
+		"  -w  only write\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_thread threads[MAX_THREADS];
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	unsigned int nthreads = 1;
+	size_t size = DEFAULT_SIZE;
+	int pin = 0, write_only = 0;
+	uint64_t *latency_ns, start, elapsed_ns, total;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:t:aw")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			pin = 1;
+			break;
+		case 'w':
+			write_only = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || !iterations || !size || size > MAX_SIZE ||
+	    !nthreads || nthreads > MAX_THREADS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	total = (uint64_t)iterations * nthreads;
+	latency_ns = calloc(total, sizeof(*latency_ns));
+	if (!latency_ns) {
+		perror("calloc");
+		return 1;
+	}
+
+	start = now_ns();
+
+	for (i = 0; i < nthreads; i++) {
+		threads[i] = (struct bench_thread) {
+			.path = argv[optind],
+			.iterations = iterations,
+			.size = size,
+			.latency_ns = &latency_ns[(uint64_t)i * iterations],
+			.cpu = pin ? (int)i : -1,
+			.write_only = write_only,
+		};
+		pthread_create(&threads[i].thread, NULL, bench_run,
+			       &threads[i]);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	elapsed_ns = now_ns() - start;
+
+	for (i = 0; i < nthreads; i++) {
+		if (threads[i].err) {
+			fprintf(stderr, "%s: %s\n", argv[optind],
+				strerror(threads[i].err));
+			free(latency_ns);
+			return 1;
+		}
+	}
+
+	qsort(latency_ns, total, sizeof(*latency_ns), cmp_u64);
+
+	printf("device:      %s\n", argv[optind]);
+	printf("threads:     %u%s\n", nthreads, pin ? ", pinned" : "");
+	printf("size:        %zu bytes%s\n", size,
+	       write_only ? ", writes only" : "");
+	printf("ops:         %llu in %.3f s (%.0f/s)\n",
+	       (unsigned long long)total, elapsed_ns / 1e9,
+	       total / (elapsed_ns / 1e9));
+	printf("latency ns:  p50 %llu  p99 %llu  max %llu\n",
+	       (unsigned long long)latency_ns[total / 2],
+	       (unsigned long long)latency_ns[total * 99 / 100],
+	       (unsigned long long)latency_ns[total - 1]);
+
+	free(latency_ns);
+
+	return 0;
+}
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Message slots of the echo device
+ *
+ * Without sharding there is a single slot and this behaves like the original
+ * shared buffer. With shards=cpu or shards=node every CPU or node writes to
+ * its own slot, so writers never touch each other's cache lines.
+ * Reading the latest message then has to look at every slot, which moves the
+ * cost from writers to readers.
+ *
+ * Callers copy messages from and to userspace themselves, so the slot locks
+ * are only held for a memcpy of at most BUF_SIZE bytes. They also hold
+ * echo_op_begin, so the slots aren't freed under them by a disable.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/smp.h>
+#include <linux/topology.h>
+#include <linux/nodemask.h>
+#include <linux/cpumask.h>
+#include <linux/timekeeping.h>
+#include "echo_module.h"
+
+static const char disabled_msg[] = "Device is disabled\n";
+
+/*
+ * Indexed by CPU or node, with NULL for ones that are not possible. The array
+ * is NULL until the first write after the device is enabled, and is freed
+ * again when it is disabled.
+ */
+static struct echo_shard **shards;
+static unsigned int nr_shards;
+static DEFINE_MUTEX(shards_lock); // serializes allocating shards
+
+static void shards_free(struct echo_shard **array)
+{
+	unsigned int i;
+
+	if (!array)
+		return;
+
+	for (i = 0; i < nr_shards; i++)
+		kfree(array[i]);
+
+	kfree(array);
+}
+
+static int shard_alloc(struct echo_shard **array, unsigned int index, int node)
+{
+	array[index] = kzalloc_node(sizeof(struct echo_shard), GFP_KERNEL,
+				    node);
+	if (!array[index])
+		return -ENOMEM;
+
+	spin_lock_init(&array[index]->lock);
+
+	return 0;
+}
+
+static struct echo_shard **shards_alloc(void)
+{
+	struct echo_shard **array;
+	unsigned int i;
+	int ret = 0;
+
+	array = kcalloc(nr_shards, sizeof(*array), GFP_KERNEL);
+	if (!array)
+		return NULL;
+
+	switch (shard_mode) {
+	case SHARD_CPU:
+		for_each_possible_cpu(i) {
+			ret = shard_alloc(array, i, cpu_to_node(i));
+			if (ret)
+				break;
+		}
+		break;
+	case SHARD_NODE:
+		for_each_node(i) {
+			ret = shard_alloc(array, i, i);
+			if (ret)
+				break;
+		}
+		break;
+	default:
+		ret = shard_alloc(array, 0, NUMA_NO_NODE);
+	}
+
+	if (ret) {
+		shards_free(array);
+		return NULL;
+	}
+
+	return array;
+}
+
+// Returns the slots, allocating them for the first write since enabling
+static struct echo_shard **shards_get(void)
+{
+	struct echo_shard **array = smp_load_acquire(&shards);
+
+	if (array)
+		return array;
+
+	mutex_lock(&shards_lock);
+
+	array = shards;
+	if (!array) {
+		array = shards_alloc();
+		// Slots are initialized before other writers can see them
+		smp_store_release(&shards, array);
+	}
+
+	mutex_unlock(&shards_lock);
+
+	return array;
+}
+
+// Nothing is allocated until the first write
+void echo_buffer_init(void)
+{
+	switch (shard_mode) {
+	case SHARD_CPU:
+		nr_shards = nr_cpu_ids;
+		break;
+	case SHARD_NODE:
+		nr_shards = nr_node_ids;
+		break;
+	default:
+		nr_shards = 1;
+	}
+}
+
+// Only called with no reads or writes in progress
+void echo_buffer_free(void)
+{
+	shards_free(shards);
+	shards = NULL;
+}
+
+// The caller may have moved CPU by the time the slot is locked, which is fine
+static struct echo_shard *local_shard(struct echo_shard **array)
+{
+	switch (shard_mode) {
+	case SHARD_CPU:
+		return array[raw_smp_processor_id()];
+	case SHARD_NODE:
+		return array[numa_node_id()];
+	default:
+		return array[0];
+	}
+}
+
+// Stores a message in the writer's slot
+ssize_t echo_put(const char *msg, size_t len)
+{
+	struct echo_shard **array;
+	struct echo_shard *shard;
+
+	// Can't write if device isn't enabled
+	if (!echo_enabled())
+		return -EBUSY;
+
+	array = shards_get();
+	if (!array)
+		return -ENOMEM;
+
+	len = min_t(size_t, BUF_SIZE - 1, len);
+	shard = local_shard(array);
+
+	spin_lock(&shard->lock);
+	memcpy(shard->data, msg, len);
+	shard->len = len;
+	shard->stamp = ktime_get_ns();
+	spin_unlock(&shard->lock);
+
+	return len;
+}
+
+// Copies the message of shard into msg if it is newer than *stamp
+static void shard_get_newer(struct echo_shard *shard, char *msg, size_t *len,
+			    u64 *stamp)
+{
+	// Skips older slots without taking their lock
+	if (READ_ONCE(shard->stamp) <= *stamp)
+		return;
+
+	spin_lock(&shard->lock);
+	if (shard->stamp > *stamp) {
+		memcpy(msg, shard->data, shard->len);
+		*len = shard->len;
+		*stamp = shard->stamp;
+	}
+	spin_unlock(&shard->lock);
+}
+
+/*
+ * Copies a message into msg, which holds BUF_SIZE bytes. With local that is
+ * the message of the reader's slot, otherwise the newest of all slots. When
+ * the device is disabled it is disabled_msg instead.
+ *
+ * Returns the length of the message
+ */
+ssize_t echo_get(char *msg, bool local)
+{
+	struct echo_shard **array;
+	size_t len = 0;
+	u64 stamp = 0;
+	unsigned int i;
+
+	if (!echo_enabled()) {
+		memcpy(msg, disabled_msg, sizeof(disabled_msg) - 1);
+		return sizeof(disabled_msg) - 1;
+	}
+
+	// Nothing written since enabling
+	array = smp_load_acquire(&shards);
+	if (!array)
+		return 0;
+
+	if (local) {
+		shard_get_newer(local_shard(array), msg, &len, &stamp);
+		return len;
+	}
+
+	for (i = 0; i < nr_shards; i++)
+		if (array[i])
+			shard_get_newer(array[i], msg, &len, &stamp);
+
+	return len;
+}
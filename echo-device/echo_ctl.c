@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Enabling and disabling the echo device
+ *
+ * Every read, write, io_uring command and batch runs between echo_op_begin
+ * and echo_op_end, the read side of a per-CPU rw semaphore, which costs no
+ * shared cache line. Disabling first moves to ECHO_STATE_DRAINING, where new
+ * writes fail and readers take what is left in the queues. Then it takes the
+ * write side, which waits for the operations in progress, and frees all
+ * messages and slots. The slots are allocated again by the first write after
+ * the device is enabled.
+ *
+ * The state is controlled through the enabled attribute of the device in
+ * sysfs, or the ioctls in echo_uapi.h.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/mutex.h>
+#include <linux/percpu-rwsem.h>
+#include <linux/jiffies.h>
+#include <linux/sysfs.h>
+#include "echo_module.h"
+#include "echo_uapi.h"
+
+static unsigned int drain_ms = 1000;
+module_param(drain_ms, uint, 0644);
+MODULE_PARM_DESC(drain_ms, "Milliseconds a disable through sysfs waits for the queues to drain");
+
+DEFINE_STATIC_PERCPU_RWSEM(echo_ops_sem);
+static DEFINE_MUTEX(echo_ctl_lock); // serializes enabling and disabling
+static u32 echo_state = ECHO_STATE_ENABLED;
+
+/*
+ * With nowait, fails instead of waiting for a disable to finish.
+ *
+ * Returns true if echo_op_end has to be called
+ */
+bool echo_op_begin(bool nowait)
+{
+	if (nowait)
+		return percpu_down_read_trylock(&echo_ops_sem);
+
+	percpu_down_read(&echo_ops_sem);
+
+	return true;
+}
+
+void echo_op_end(void)
+{
+	percpu_up_read(&echo_ops_sem);
+}
+
+bool echo_enabled(void)
+{
+	return READ_ONCE(echo_state) == ECHO_STATE_ENABLED;
+}
+
+int echo_ctl_enable(void)
+{
+	int ret;
+
+	ret = mutex_lock_interruptible(&echo_ctl_lock);
+	if (ret)
+		return ret;
+
+	// Nothing is allocated here, the first write does that
+	if (echo_state == ECHO_STATE_DISABLED) {
+		WRITE_ONCE(echo_state, ECHO_STATE_ENABLED);
+		pr_info("echo_device: enabled\n");
+	}
+
+	mutex_unlock(&echo_ctl_lock);
+
+	return 0;
+}
+
+int echo_ctl_disable(unsigned int timeout_ms)
+{
+	u32 msgs;
+	int ret;
+
+	ret = mutex_lock_interruptible(&echo_ctl_lock);
+	if (ret)
+		return ret;
+
+	if (echo_state != ECHO_STATE_ENABLED)
+		goto unlock;
+
+	WRITE_ONCE(echo_state, ECHO_STATE_DRAINING);
+
+	// Blocked writers fail, blocked readers return once the queues are empty
+	echo_queue_wake_all();
+
+	if (timeout_ms)
+		echo_queue_drain(msecs_to_jiffies(timeout_ms));
+
+	percpu_down_write(&echo_ops_sem);
+
+	WRITE_ONCE(echo_state, ECHO_STATE_DISABLED);
+
+	echo_queue_stats(&msgs, NULL);
+	if (msgs)
+		pr_info("echo_device: discarding %u queued messages\n", msgs);
+
+	echo_queue_flush();
+	echo_buffer_free();
+
+	percpu_up_write(&echo_ops_sem);
+
+	pr_info("echo_device: disabled\n");
+
+unlock:
+	mutex_unlock(&echo_ctl_lock);
+
+	return 0;
+}
+
+void echo_ctl_status(struct echo_status *status)
+{
+	status->state = READ_ONCE(echo_state);
+	echo_queue_stats(&status->queued_msgs, &status->queued_bytes);
+}
+
+static ssize_t enabled_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	return sysfs_emit(buf, "%d\n", echo_enabled());
+}
+
+static ssize_t enabled_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret)
+		return ret;
+
+	if (enable)
+		ret = echo_ctl_enable();
+	else
+		ret = echo_ctl_disable(READ_ONCE(drain_ms));
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(enabled);
+
+static ssize_t queued_msgs_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	u32 msgs;
+
+	echo_queue_stats(&msgs, NULL);
+
+	return sysfs_emit(buf, "%u\n", msgs);
+}
+static DEVICE_ATTR_RO(queued_msgs);
+
+static ssize_t queued_bytes_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	u64 bytes;
+
+	echo_queue_stats(NULL, &bytes);
+
+	return sysfs_emit(buf, "%llu\n", bytes);
+}
+static DEVICE_ATTR_RO(queued_bytes);
+
+static struct attribute *echo_attrs[] = {
+	&dev_attr_enabled.attr,
+	&dev_attr_queued_msgs.attr,
+	&dev_attr_queued_bytes.attr,
+	NULL
+};
+
+static const struct attribute_group echo_group = {
+	.attrs = echo_attrs,
+};
+
+const struct attribute_group *echo_groups[] = {
+	&echo_group,
+	NULL
+};
@@ -8,62 +8,159 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/errno.h>
-#include <linux/atomic.h>
-#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/err.h>
 #include "echo_module.h"
+#include "echo_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "echo_trace.h"
+
+static int echo_cdev_open(struct inode *inode, struct file *file)
+{
+	struct echo_file *ef;
+
+	ef = kzalloc(sizeof(*ef), GFP_KERNEL);
+	if (!ef)
+		return -ENOMEM;
+
+	ef->read_mode = ECHO_READ_LATEST;
+	file->private_data = ef;
+
+	return 0;
+}
+
+static int echo_cdev_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+
+	return 0;
+}
+
+/*
+ * Takes one whole message from the queues, truncated to count. Returns 0
+ * once the queues are empty and the device isn't enabled.
+ */
+static ssize_t echo_queue_read(struct file *file, char __user *buf,
+			       size_t count)
+{
+	struct echo_msg *msg;
+	ssize_t len;
+
+	msg = echo_queue_get(file->f_flags & O_NONBLOCK);
+	if (IS_ERR_OR_NULL(msg))
+		return PTR_ERR_OR_ZERO(msg);
+
+	len = min(count, msg->len);
+	if (copy_to_user(buf, msg->data, len))
+		len = -EFAULT;
+
+	kfree(msg);
+
+	return len;
+}
+
+static ssize_t echo_queue_write(struct file *file, const char __user *buf,
+				size_t count, u32 tag)
+{
+	struct echo_msg *msg;
+	int ret;
+
+	msg = echo_msg_alloc(tag, count);
+	if (IS_ERR(msg))
+		return PTR_ERR(msg);
+
+	if (copy_from_user(msg->data, buf, count)) {
+		ret = -EFAULT;
+		goto free;
+	}
+
+	ret = echo_queue_put(msg, file->f_flags & O_NONBLOCK);
+	if (ret)
+		goto free;
+
+	return count;
+
+free:
+	kfree(msg);
+	return ret;
+}
 
 static ssize_t echo_cdev_read(struct file *file, char __user *buf, size_t count,
 		       loff_t *pos)
 {
-	char disable_buf[BUF_SIZE] = "Device is disabled\n";
-	char (*message)[BUF_SIZE] = &buffer;
-	size_t len;
+	struct echo_file *ef = file->private_data;
+	char message[BUF_SIZE];
+	loff_t start = *pos;
+	ssize_t len;
+
+	echo_op_begin(false);
 
-	// Message is the buffer if enabled. Is disable_buf if disabled
-	if (!atomic_read(&device_enabled))
-		message = &disable_buf;
+	if (READ_ONCE(ef->read_mode) == ECHO_READ_QUEUE) {
+		len = echo_queue_read(file, buf, count);
+		echo_op_end();
+		trace_echo_cdev_read(count, start, len);
+		return len;
+	}
 
-	len = min(strlen(*message), count);
+	len = echo_get(message, READ_ONCE(ef->read_mode) == ECHO_READ_LOCAL);
 
-	if (*pos >= len)
-		return 0;
+	echo_op_end();
 
-	mutex_lock(&buffer_lock);
-	// Doesn't work when device is disabled??? Probably fine, as the message
-	// when disabled is a string literal which is *hopefully*
-	// null-terminated during initialization
-	if (atomic_read(&device_enabled))
-		*message[len - 1] = '\0';
+	if (len < 0)
+		return len;
 
-	if (copy_to_user(buf, *message + *pos, len))
-		return -EFAULT;
+	len = simple_read_from_buffer(buf, count, pos, message, len);
 
-	mutex_unlock(&buffer_lock);
+	trace_echo_cdev_read(count, start, len);
 
-	*pos += len;
 	return len;
 }
 
 static ssize_t echo_cdev_write(struct file *file, const char __user *buf,
 			       size_t count, loff_t *pos)
 {
+	struct echo_file *ef = file->private_data;
+	char message[BUF_SIZE];
+	u32 tag = READ_ONCE(ef->write_tag);
+	ssize_t ret;
+
+	echo_op_begin(false);
+
 	// Can't write if device isn't enabled
-	if (!atomic_read(&device_enabled))
-		return -EBUSY;
+	if (!echo_enabled()) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (tag) {
+		ret = echo_queue_write(file, buf, count, tag);
+		goto out;
+	}
 
 	count = min_t(size_t, BUF_SIZE - 1, count);
 
-	mutex_lock(&buffer_lock);
-	if (copy_from_user(buffer, buf, count))
-		return -EFAULT;
+	if (copy_from_user(message, buf, count)) {
+		ret = -EFAULT;
+		goto out;
+	}
 
-	buffer[count] = '\0';
-	mutex_unlock(&buffer_lock);
+	ret = echo_put(message, count);
 
-	return count;
+out:
+	echo_op_end();
+
+	trace_echo_cdev_write(count, *pos, ret);
+
+	return ret;
 }
 
 const struct file_operations echo_cdev_ops = {
+	.open = echo_cdev_open,
+	.release = echo_cdev_release,
 	.read = echo_cdev_read,
 	.write = echo_cdev_write,
+	.unlocked_ioctl = echo_cdev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.uring_cmd = echo_cdev_uring_cmd,
 };
@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * ioctls of the echo device, defined in echo_uapi.h
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include "echo_module.h"
+#include "echo_uapi.h"
+
+static long echo_set_read_mode(struct echo_file *ef, u32 __user *arg)
+{
+	u32 mode;
+
+	if (get_user(mode, arg))
+		return -EFAULT;
+
+	if (mode != ECHO_READ_LATEST && mode != ECHO_READ_LOCAL &&
+	    mode != ECHO_READ_QUEUE)
+		return -EINVAL;
+
+	WRITE_ONCE(ef->read_mode, mode);
+
+	return 0;
+}
+
+static long echo_ioc_queue_create(struct echo_queue_attr __user *arg)
+{
+	struct echo_queue_attr attr;
+
+	if (copy_from_user(&attr, arg, sizeof(attr)))
+		return -EFAULT;
+
+	return echo_queue_create(&attr);
+}
+
+static long echo_ioc_queue_destroy(u32 __user *arg)
+{
+	u32 tag;
+
+	if (get_user(tag, arg))
+		return -EFAULT;
+
+	return echo_queue_destroy(tag);
+}
+
+// The queue isn't checked until a write, since it can be destroyed anyway
+static long echo_set_write_queue(struct echo_file *ef, u32 __user *arg)
+{
+	u32 tag;
+
+	if (get_user(tag, arg))
+		return -EFAULT;
+
+	WRITE_ONCE(ef->write_tag, tag);
+
+	return 0;
+}
+
+// Returns the descriptors of the batch, which the caller kvfrees
+static struct echo_msg_desc *echo_batch_copy_in(struct echo_batch __user *arg,
+						struct echo_batch *batch)
+{
+	struct echo_msg_desc *descs;
+	unsigned int i;
+
+	if (copy_from_user(batch, arg, sizeof(*batch)))
+		return ERR_PTR(-EFAULT);
+
+	if (!batch->count || batch->count > ECHO_BATCH_MAX)
+		return ERR_PTR(-EINVAL);
+
+	descs = vmemdup_array_user(u64_to_user_ptr(batch->descs), batch->count,
+				   sizeof(*descs));
+	if (IS_ERR(descs))
+		return descs;
+
+	for (i = 0; i < batch->count; i++) {
+		if (descs[i].reserved) {
+			kvfree(descs);
+			return ERR_PTR(-EINVAL);
+		}
+	}
+
+	return descs;
+}
+
+// Writes back the first count descriptors, and done
+static long echo_batch_copy_out(struct echo_batch __user *arg,
+				const struct echo_batch *batch,
+				const struct echo_msg_desc *descs,
+				unsigned int count, unsigned int done)
+{
+	if (copy_to_user(u64_to_user_ptr(batch->descs), descs,
+			 array_size(count, sizeof(*descs))) ||
+	    put_user(done, &arg->done))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * Messages are allocated and copied in first, so the queue lock is taken
+ * once for the whole batch. Every descriptor gets a status, done counts the
+ * ones that were queued.
+ */
+static long echo_send_batch(struct echo_batch __user *arg)
+{
+	struct echo_msg_desc *descs;
+	struct echo_msg **msgs;
+	struct echo_batch batch;
+	unsigned int i, done;
+	int *status;
+	long ret;
+
+	if (!echo_enabled())
+		return -EBUSY;
+
+	descs = echo_batch_copy_in(arg, &batch);
+	if (IS_ERR(descs))
+		return PTR_ERR(descs);
+
+	msgs = kcalloc(batch.count, sizeof(*msgs), GFP_KERNEL);
+	status = kcalloc(batch.count, sizeof(*status), GFP_KERNEL);
+	if (!msgs || !status) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < batch.count; i++) {
+		msgs[i] = echo_msg_alloc(descs[i].tag, descs[i].len);
+		if (IS_ERR(msgs[i])) {
+			status[i] = PTR_ERR(msgs[i]);
+			msgs[i] = NULL;
+			continue;
+		}
+
+		if (copy_from_user(msgs[i]->data,
+				   u64_to_user_ptr(descs[i].addr),
+				   descs[i].len)) {
+			status[i] = -EFAULT;
+			kfree(msgs[i]);
+			msgs[i] = NULL;
+		}
+	}
+
+	echo_op_begin(false);
+
+	// A disable may have started while the messages were copied
+	if (echo_enabled()) {
+		done = echo_queue_put_batch(msgs, status, batch.count);
+	} else {
+		for (i = 0; i < batch.count; i++)
+			if (msgs[i])
+				status[i] = -EBUSY;
+		done = 0;
+	}
+
+	echo_op_end();
+
+	for (i = 0; i < batch.count; i++) {
+		descs[i].status = status[i];
+		if (status[i])
+			kfree(msgs[i]);
+	}
+
+	ret = echo_batch_copy_out(arg, &batch, descs, batch.count, done);
+
+free:
+	kfree(status);
+	kfree(msgs);
+	kvfree(descs);
+
+	return ret;
+}
+
+/*
+ * Takes up to count messages under one lock acquisition, then copies each
+ * to its descriptor's buffer. A message longer than the buffer is cut short
+ * and gets -EMSGSIZE, like a datagram.
+ */
+static long echo_recv_batch(struct file *file, struct echo_batch __user *arg)
+{
+	struct echo_msg_desc *descs;
+	struct echo_msg **msgs;
+	struct echo_batch batch;
+	unsigned int i;
+	u32 len;
+	long ret;
+	int n;
+
+	descs = echo_batch_copy_in(arg, &batch);
+	if (IS_ERR(descs))
+		return PTR_ERR(descs);
+
+	msgs = kcalloc(batch.count, sizeof(*msgs), GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto free_descs;
+	}
+
+	echo_op_begin(false);
+	n = echo_queue_get_batch(msgs, batch.count,
+				 file->f_flags & O_NONBLOCK);
+	echo_op_end();
+	if (n < 0) {
+		ret = n;
+		goto free_msgs;
+	}
+
+	for (i = 0; i < n; i++) {
+		len = min_t(u32, msgs[i]->len, descs[i].len);
+
+		if (copy_to_user(u64_to_user_ptr(descs[i].addr),
+				 msgs[i]->data, len))
+			descs[i].status = -EFAULT;
+		else if (len < msgs[i]->len)
+			descs[i].status = -EMSGSIZE;
+		else
+			descs[i].status = 0;
+
+		descs[i].len = len;
+		descs[i].tag = msgs[i]->tag;
+		kfree(msgs[i]);
+	}
+
+	ret = echo_batch_copy_out(arg, &batch, descs, n, n);
+
+free_msgs:
+	kfree(msgs);
+free_descs:
+	kvfree(descs);
+
+	return ret;
+}
+
+static long echo_ioc_disable(u32 __user *arg)
+{
+	u32 timeout_ms;
+
+	if (get_user(timeout_ms, arg))
+		return -EFAULT;
+
+	return echo_ctl_disable(timeout_ms);
+}
+
+static long echo_ioc_get_status(struct echo_status __user *arg)
+{
+	struct echo_status status;
+
+	echo_ctl_status(&status);
+
+	if (copy_to_user(arg, &status, sizeof(status)))
+		return -EFAULT;
+
+	return 0;
+}
+
+long echo_cdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct echo_file *ef = file->private_data;
+	void __user *uarg = (void __user *)arg;
+
+	switch (cmd) {
+	case ECHO_IOC_SET_READ_MODE:
+		return echo_set_read_mode(ef, uarg);
+	case ECHO_IOC_QUEUE_CREATE:
+		return echo_ioc_queue_create(uarg);
+	case ECHO_IOC_QUEUE_DESTROY:
+		return echo_ioc_queue_destroy(uarg);
+	case ECHO_IOC_SET_WRITE_QUEUE:
+		return echo_set_write_queue(ef, uarg);
+	case ECHO_IOC_SEND_BATCH:
+		return echo_send_batch(uarg);
+	case ECHO_IOC_RECV_BATCH:
+		return echo_recv_batch(file, uarg);
+	case ECHO_IOC_ENABLE:
+		return echo_ctl_enable();
+	case ECHO_IOC_DISABLE:
+		return echo_ioc_disable(uarg);
+	case ECHO_IOC_GET_STATUS:
+		return echo_ioc_get_status(uarg);
+	default:
+		return -ENOTTY;
+	}
+}
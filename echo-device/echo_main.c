@@ -3,22 +3,19 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/init.h>
-#include <linux/proc_fs.h>
 #include <linux/cdev.h>
 #include <linux/errno.h>
-#include <linux/atomic.h>
-#include <linux/mutex.h>
+#include <linux/string.h>
 #include "echo_module.h"
 
-#define PROC_NAME "echo_status"
 #define CDEV_NAME "echo_device"
 
-DEFINE_MUTEX(buffer_lock);
+enum echo_shard_mode shard_mode = SHARD_NONE;
 
-atomic_t device_enabled = ATOMIC_INIT(1);
-char buffer[BUF_SIZE] = "";
+static char *shards = "none";
+module_param(shards, charp, 0444);
+MODULE_PARM_DESC(shards, "Message slots: none, cpu (one per CPU) or node (one per NUMA node)");
 
-static struct proc_dir_entry *proc_entry;
 static struct cdev echo_cdev;
 static dev_t dev_num;
 static struct class *echo_class;
@@ -28,16 +25,21 @@ static int __init my_module_init(void)
 {
 	int err_ret = 0;
 
-	proc_entry = proc_create(PROC_NAME, 0664, NULL, &echo_proc_ops);
-	if (!proc_entry) {
-		pr_err("echo_device: Failed to create /proc file");
-		return -ENOMEM;
+	if (!strcmp(shards, "cpu")) {
+		shard_mode = SHARD_CPU;
+	} else if (!strcmp(shards, "node")) {
+		shard_mode = SHARD_NODE;
+	} else if (strcmp(shards, "none")) {
+		pr_err("echo_device: Unknown shards mode %s", shards);
+		return -EINVAL;
 	}
 
+	echo_buffer_init();
+
 	err_ret = (alloc_chrdev_region(&dev_num, 0, 1, CDEV_NAME) < 0);
 	if (err_ret) {
 		pr_err("echo_device: Failed to allocate cdev");
-		goto alloc_chrdev_err;
+		return err_ret;
 	}
 
 	cdev_init(&echo_cdev, &echo_cdev_ops);
@@ -54,7 +56,9 @@ static int __init my_module_init(void)
 		goto class_create_err;
 	}
 
-	echo_device = device_create(echo_class, NULL, dev_num, NULL, CDEV_NAME);
+	// Adds the enabled and queued_* attributes of echo_ctl.c
+	echo_device = device_create_with_groups(echo_class, NULL, dev_num, NULL,
+						echo_groups, CDEV_NAME);
 	if (IS_ERR(echo_device)) {
 		pr_err("echo_device: Failed creating device");
 		err_ret = PTR_ERR(echo_device);
@@ -70,19 +74,17 @@ class_create_err:
 	cdev_del(&echo_cdev);
 cdev_add_err:
 	unregister_chrdev_region(dev_num, 1);
-alloc_chrdev_err:
-	proc_remove(proc_entry);
 	return err_ret;
 }
 
 static void __exit my_module_exit(void)
 {
-	proc_remove(proc_entry);
-
 	device_destroy(echo_class, dev_num);
 	class_destroy(echo_class);
 	cdev_del(&echo_cdev);
 	unregister_chrdev_region(dev_num, 1);
+	echo_queue_exit();
+	echo_buffer_free();
 
 	pr_info("echo_device: Exited\n");
 }
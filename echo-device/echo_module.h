@@ -3,16 +3,87 @@
 #ifndef MODULE_ECHO_H
 #define MODULE_ECHO_H
 
-#include <linux/atomic.h>
-#include <linux/mutex.h>
+#include <linux/cache.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
 
 #define BUF_SIZE 256
 
-extern atomic_t device_enabled;
-extern char buffer[BUF_SIZE];
-extern struct mutex buffer_lock;
+struct io_uring_cmd;
+struct attribute_group;
+
+// Which slot a write goes to, picked with the shards module parameter
+enum echo_shard_mode {
+	SHARD_NONE, // one slot shared by everyone
+	SHARD_CPU,  // a slot per CPU
+	SHARD_NODE  // a slot per NUMA node
+};
+
+/**
+ * A slot holding the last message written to it
+ *
+ * Sharded slots are allocated on the node of their CPU or node, and each is
+ * on its own cache lines, so writers on different CPUs don't share any.
+ * stamp orders messages across slots.
+ */
+struct echo_shard {
+	spinlock_t lock; // protects the rest
+	u64 stamp; // ktime_get_ns() of the last write, 0 if never written
+	size_t len;
+	char data[BUF_SIZE];
+} ____cacheline_aligned_in_smp;
+
+// Per open file state, in file->private_data
+struct echo_file {
+	u32 read_mode; // ECHO_READ_* from echo_uapi.h
+	u32 write_tag; // queue writes go to, 0 for the shards
+};
+
+struct echo_queue_attr;
+struct echo_status;
+
+// A message in one of the queues
+struct echo_msg {
+	struct list_head node; // in queue->msgs
+	u32 tag; // of the queue it is for
+	size_t len;
+	char data[];
+};
+
+extern enum echo_shard_mode shard_mode;
 
-extern const struct proc_ops echo_proc_ops;
 extern const struct file_operations echo_cdev_ops;
+extern const struct attribute_group *echo_groups[];
+
+bool echo_op_begin(bool nowait);
+void echo_op_end(void);
+bool echo_enabled(void);
+int echo_ctl_enable(void);
+int echo_ctl_disable(unsigned int timeout_ms);
+void echo_ctl_status(struct echo_status *status);
+
+void echo_buffer_init(void);
+void echo_buffer_free(void);
+ssize_t echo_put(const char *msg, size_t len);
+ssize_t echo_get(char *msg, bool local);
+
+int echo_queue_create(const struct echo_queue_attr *attr);
+int echo_queue_destroy(u32 tag);
+void echo_queue_exit(void);
+void echo_queue_flush(void);
+void echo_queue_stats(u32 *msgs, u64 *bytes);
+void echo_queue_wake_all(void);
+long echo_queue_drain(long timeout);
+struct echo_msg *echo_msg_alloc(u32 tag, size_t len);
+int echo_queue_put(struct echo_msg *msg, bool nonblock);
+struct echo_msg *echo_queue_get(bool nonblock);
+unsigned int echo_queue_put_batch(struct echo_msg **msgs, int *status,
+				  unsigned int count);
+int echo_queue_get_batch(struct echo_msg **msgs, unsigned int count,
+			 bool nonblock);
+
+long echo_cdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+int echo_cdev_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
 
 #endif /* MODULE_ECHO_H */
@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Tagged priority queues of the echo device
+ *
+ * Queues are kept sorted by descending priority, so a reader takes the first
+ * message of the first non-empty queue. Control messages in a high priority
+ * queue are then never stuck behind bulk data in a low priority one.
+ *
+ * Messages are allocated and copied from userspace before queues_lock is
+ * taken, so it only covers list operations.
+ *
+ * Once the device stops being enabled, blocked writers fail with -EBUSY and
+ * readers get no message once the queues are empty, instead of waiting.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/err.h>
+#include "echo_module.h"
+#include "echo_uapi.h"
+
+struct echo_queue {
+	struct list_head node; // in echo_queues
+	u32 tag;
+	u32 priority;
+	u32 depth;
+	u32 count; // messages in msgs
+	size_t bytes; // of the messages in msgs
+	struct list_head msgs;
+};
+
+// By descending priority, and by creation among equal priorities
+static LIST_HEAD(echo_queues);
+static DEFINE_SPINLOCK(queues_lock); // protects echo_queues and their messages
+static unsigned int nr_queues;
+static unsigned int nr_queued; // messages in all queues
+static u64 nr_queued_bytes;
+
+// Readers wait for messages, writers for space in their queue
+static DECLARE_WAIT_QUEUE_HEAD(queue_readers);
+static DECLARE_WAIT_QUEUE_HEAD(queue_writers);
+
+static struct echo_queue *find_queue(u32 tag)
+{
+	struct echo_queue *queue;
+
+	list_for_each_entry(queue, &echo_queues, node)
+		if (queue->tag == tag)
+			return queue;
+
+	return NULL;
+}
+
+static void free_msgs(struct list_head *msgs)
+{
+	struct echo_msg *msg, *tmp;
+
+	list_for_each_entry_safe(msg, tmp, msgs, node)
+		kfree(msg);
+}
+
+int echo_queue_create(const struct echo_queue_attr *attr)
+{
+	struct echo_queue *queue, *pos;
+	int ret = 0;
+
+	if (!attr->tag || !attr->depth || attr->depth > ECHO_MAX_DEPTH ||
+	    attr->reserved)
+		return -EINVAL;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return -ENOMEM;
+
+	queue->tag = attr->tag;
+	queue->priority = attr->priority;
+	queue->depth = attr->depth;
+	INIT_LIST_HEAD(&queue->msgs);
+
+	spin_lock(&queues_lock);
+
+	if (find_queue(attr->tag)) {
+		ret = -EEXIST;
+		goto unlock;
+	}
+
+	if (nr_queues >= ECHO_MAX_QUEUES) {
+		ret = -ENOSPC;
+		goto unlock;
+	}
+
+	// Goes in front of the first queue with a lower priority
+	list_for_each_entry(pos, &echo_queues, node)
+		if (pos->priority < queue->priority)
+			break;
+	list_add_tail(&queue->node, &pos->node);
+	nr_queues++;
+
+unlock:
+	spin_unlock(&queues_lock);
+
+	if (ret)
+		kfree(queue);
+
+	return ret;
+}
+
+int echo_queue_destroy(u32 tag)
+{
+	struct echo_queue *queue;
+
+	spin_lock(&queues_lock);
+
+	queue = find_queue(tag);
+	if (!queue) {
+		spin_unlock(&queues_lock);
+		return -ENOENT;
+	}
+
+	list_del(&queue->node);
+	nr_queues--;
+	nr_queued -= queue->count;
+	nr_queued_bytes -= queue->bytes;
+
+	spin_unlock(&queues_lock);
+
+	// Writers waiting for space in it find it gone
+	wake_up_interruptible(&queue_writers);
+
+	free_msgs(&queue->msgs);
+	kfree(queue);
+
+	return 0;
+}
+
+void echo_queue_exit(void)
+{
+	struct echo_queue *queue, *tmp;
+
+	list_for_each_entry_safe(queue, tmp, &echo_queues, node) {
+		free_msgs(&queue->msgs);
+		kfree(queue);
+	}
+
+	INIT_LIST_HEAD(&echo_queues);
+	nr_queues = 0;
+	nr_queued = 0;
+	nr_queued_bytes = 0;
+}
+
+// Frees every queued message, but keeps the queues
+void echo_queue_flush(void)
+{
+	struct echo_queue *queue;
+	LIST_HEAD(msgs);
+
+	spin_lock(&queues_lock);
+
+	list_for_each_entry(queue, &echo_queues, node) {
+		list_splice_tail_init(&queue->msgs, &msgs);
+		queue->count = 0;
+		queue->bytes = 0;
+	}
+	nr_queued = 0;
+	nr_queued_bytes = 0;
+
+	spin_unlock(&queues_lock);
+
+	wake_up_interruptible(&queue_writers);
+
+	free_msgs(&msgs);
+}
+
+// Either can be NULL
+void echo_queue_stats(u32 *msgs, u64 *bytes)
+{
+	spin_lock(&queues_lock);
+
+	if (msgs)
+		*msgs = nr_queued;
+	if (bytes)
+		*bytes = nr_queued_bytes;
+
+	spin_unlock(&queues_lock);
+}
+
+// For waiters to see a change of the device state
+void echo_queue_wake_all(void)
+{
+	wake_up_interruptible_all(&queue_readers);
+	wake_up_interruptible_all(&queue_writers);
+}
+
+/*
+ * Waits up to timeout jiffies for readers to empty the queues.
+ *
+ * Returns 0 on timeout, like wait_event_interruptible_timeout
+ */
+long echo_queue_drain(long timeout)
+{
+	// Readers wake queue_writers for every message they take
+	return wait_event_interruptible_timeout(queue_writers,
+						!READ_ONCE(nr_queued),
+						timeout);
+}
+
+// The caller fills in data, and frees it unless echo_queue_put succeeds
+struct echo_msg *echo_msg_alloc(u32 tag, size_t len)
+{
+	struct echo_msg *msg;
+
+	if (len > ECHO_MSG_MAX)
+		return ERR_PTR(-EMSGSIZE);
+
+	msg = kmalloc(struct_size(msg, data, len), GFP_KERNEL);
+	if (!msg)
+		return ERR_PTR(-ENOMEM);
+
+	msg->tag = tag;
+	msg->len = len;
+
+	return msg;
+}
+
+// Returns -EAGAIN if the queue is full
+static int queue_put_locked(struct echo_msg *msg)
+{
+	struct echo_queue *queue = find_queue(msg->tag);
+
+	if (!queue)
+		return -ENOENT;
+
+	if (queue->count >= queue->depth)
+		return -EAGAIN;
+
+	list_add_tail(&msg->node, &queue->msgs);
+	queue->count++;
+	queue->bytes += msg->len;
+	nr_queued++;
+	nr_queued_bytes += msg->len;
+
+	return 0;
+}
+
+// True once the queue has space or is gone, so a put won't return -EAGAIN
+static bool queue_writable(u32 tag)
+{
+	struct echo_queue *queue;
+	bool ret;
+
+	spin_lock(&queues_lock);
+	queue = find_queue(tag);
+	ret = !queue || queue->count < queue->depth;
+	spin_unlock(&queues_lock);
+
+	return ret;
+}
+
+/*
+ * Adds the message to the end of the queue named by its tag. Without
+ * nonblock, waits for space while the queue is full, or until the device
+ * stops being enabled, which fails with -EBUSY.
+ */
+int echo_queue_put(struct echo_msg *msg, bool nonblock)
+{
+	int ret;
+
+	for (;;) {
+		spin_lock(&queues_lock);
+		ret = queue_put_locked(msg);
+		spin_unlock(&queues_lock);
+
+		if (ret != -EAGAIN || nonblock)
+			break;
+
+		ret = wait_event_interruptible(queue_writers,
+					       queue_writable(msg->tag) ||
+					       !echo_enabled());
+		if (ret)
+			break;
+
+		if (!echo_enabled()) {
+			ret = -EBUSY;
+			break;
+		}
+	}
+
+	if (!ret)
+		wake_up_interruptible(&queue_readers);
+
+	return ret;
+}
+
+// Takes the oldest message of the highest priority queue that has one
+static struct echo_msg *queue_get_locked(void)
+{
+	struct echo_queue *queue;
+	struct echo_msg *msg;
+
+	list_for_each_entry(queue, &echo_queues, node) {
+		msg = list_first_entry_or_null(&queue->msgs, struct echo_msg,
+					       node);
+		if (!msg)
+			continue;
+
+		list_del(&msg->node);
+		queue->count--;
+		queue->bytes -= msg->len;
+		nr_queued--;
+		nr_queued_bytes -= msg->len;
+
+		return msg;
+	}
+
+	return NULL;
+}
+
+/*
+ * Takes the next message of the queues, which the caller frees. Without
+ * nonblock, waits while all queues are empty.
+ *
+ * Returns NULL if the queues are empty and the device isn't enabled
+ */
+struct echo_msg *echo_queue_get(bool nonblock)
+{
+	struct echo_msg *msg;
+	int ret;
+
+	for (;;) {
+		spin_lock(&queues_lock);
+		msg = queue_get_locked();
+		spin_unlock(&queues_lock);
+
+		if (msg) {
+			wake_up_interruptible(&queue_writers);
+			return msg;
+		}
+
+		if (!echo_enabled())
+			return NULL;
+
+		if (nonblock)
+			return ERR_PTR(-EAGAIN);
+
+		ret = wait_event_interruptible(queue_readers,
+					       READ_ONCE(nr_queued) ||
+					       !echo_enabled());
+		if (ret)
+			return ERR_PTR(ret);
+	}
+}
+
+/*
+ * Queues every non-NULL message of msgs under a single lock acquisition.
+ * Never waits, a full queue fails just that message with -EAGAIN.
+ *
+ * Sets status for each queued message, and returns how many were queued
+ */
+unsigned int echo_queue_put_batch(struct echo_msg **msgs, int *status,
+				  unsigned int count)
+{
+	unsigned int i, queued = 0;
+
+	spin_lock(&queues_lock);
+
+	for (i = 0; i < count; i++) {
+		if (!msgs[i])
+			continue;
+
+		status[i] = queue_put_locked(msgs[i]);
+		if (!status[i])
+			queued++;
+	}
+
+	spin_unlock(&queues_lock);
+
+	if (queued)
+		wake_up_interruptible(&queue_readers);
+
+	return queued;
+}
+
+/*
+ * Takes up to count messages, in the order echo_queue_get would, under a
+ * single lock acquisition. Without nonblock, waits for at least one.
+ *
+ * Returns the number of messages in msgs, which the caller frees, and 0
+ * if the queues are empty and the device isn't enabled
+ */
+int echo_queue_get_batch(struct echo_msg **msgs, unsigned int count,
+			 bool nonblock)
+{
+	unsigned int n;
+	int ret;
+
+	for (;;) {
+		spin_lock(&queues_lock);
+		for (n = 0; n < count; n++) {
+			msgs[n] = queue_get_locked();
+			if (!msgs[n])
+				break;
+		}
+		spin_unlock(&queues_lock);
+
+		if (n) {
+			wake_up_interruptible(&queue_writers);
+			return n;
+		}
+
+		if (!echo_enabled())
+			return 0;
+
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(queue_readers,
+					       READ_ONCE(nr_queued) ||
+					       !echo_enabled());
+		if (ret)
+			return ret;
+	}
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0 */
+/*
+ * Tracepoints for the echo device char dev
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM echo_device
+
+#if !defined(ECHO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define ECHO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// count and pos are what the caller asked for, ret is the bytes copied
+DECLARE_EVENT_CLASS(echo_cdev_io,
+	TP_PROTO(size_t count, loff_t pos, ssize_t ret),
+	TP_ARGS(count, pos, ret),
+
+	TP_STRUCT__entry(
+		__field(size_t, count)
+		__field(loff_t, pos)
+		__field(ssize_t, ret)
+	),
+
+	TP_fast_assign(
+		__entry->count = count;
+		__entry->pos = pos;
+		__entry->ret = ret;
+	),
+
+	TP_printk("count=%zu pos=%lld ret=%zd",
+		  __entry->count, __entry->pos, __entry->ret)
+);
+
+DEFINE_EVENT(echo_cdev_io, echo_cdev_read,
+	TP_PROTO(size_t count, loff_t pos, ssize_t ret),
+	TP_ARGS(count, pos, ret)
+);
+
+DEFINE_EVENT(echo_cdev_io, echo_cdev_write,
+	TP_PROTO(size_t count, loff_t pos, ssize_t ret),
+	TP_ARGS(count, pos, ret)
+);
+
+#endif /* ECHO_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE echo_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-3.0 */
+/*
+ * Interface of the echo device shared with userspace
+ */
+
+#ifndef ECHO_UAPI_H
+#define ECHO_UAPI_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ECHO_IOC_MAGIC		'e'
+
+/*
+ * Which message reads of the file return, set per open file. Without
+ * sharding LATEST and LOCAL are the same
+ */
+#define ECHO_READ_LATEST	0 // newest message of any shard
+#define ECHO_READ_LOCAL		1 // message of the reader's CPU or node shard
+#define ECHO_READ_QUEUE		2 // takes the next message of the queues
+
+#define ECHO_IOC_SET_READ_MODE	_IOW(ECHO_IOC_MAGIC, 0x01, __u32)
+
+// Limits of the message queues
+#define ECHO_MAX_QUEUES		16
+#define ECHO_MAX_DEPTH		4096
+#define ECHO_MSG_MAX		4096 // bytes in one queued message
+
+/**
+ * A tagged message queue, shared by every open file
+ *
+ * Reads in ECHO_READ_QUEUE mode take the oldest message of the highest
+ * priority queue that has one, and block while all queues are empty. Writes
+ * block while their queue holds depth messages. Messages are kept whole, and
+ * a read with a smaller buffer gets the start of the message.
+ */
+struct echo_queue_attr {
+	__u32 tag;	// nonzero name of the queue
+	__u32 priority;	// higher is read first
+	__u32 depth;	// most messages queued at once
+	__u32 reserved;	// must be 0
+};
+
+#define ECHO_IOC_QUEUE_CREATE	_IOW(ECHO_IOC_MAGIC, 0x02, struct echo_queue_attr)
+// Frees the queue with the tag and any messages still in it
+#define ECHO_IOC_QUEUE_DESTROY	_IOW(ECHO_IOC_MAGIC, 0x03, __u32)
+// Writes of the file go to the queue with the tag, or the buffer with 0
+#define ECHO_IOC_SET_WRITE_QUEUE _IOW(ECHO_IOC_MAGIC, 0x04, __u32)
+
+/**
+ * One message of a batch
+ *
+ * ECHO_IOC_SEND_BATCH queues the len bytes at addr in the queue with the tag.
+ * ECHO_IOC_RECV_BATCH copies up to len bytes of a message to addr, and sets
+ * len and tag to what was copied and the queue it came from. status is 0, or
+ * a negative errno for just this message, e.g. -EAGAIN for a full queue or
+ * -EMSGSIZE for a message cut short on receive.
+ */
+struct echo_msg_desc {
+	__u64 addr;
+	__u32 len;
+	__u32 tag;
+	__s32 status;
+	__u32 reserved; // must be 0
+};
+
+/**
+ * Argument of the batch ioctls
+ *
+ * Each batch takes the queue lock once for all its messages. Sends never
+ * block, a full queue fails just that message. Receives block until at least
+ * one message is queued, unless the file is O_NONBLOCK.
+ */
+struct echo_batch {
+	__u64 descs;	// array of count struct echo_msg_desc
+	__u32 count;	// at most ECHO_BATCH_MAX
+	__u32 done;	// set to the number of messages sent or received
+};
+
+#define ECHO_BATCH_MAX		256
+
+#define ECHO_IOC_SEND_BATCH	_IOWR(ECHO_IOC_MAGIC, 0x05, struct echo_batch)
+#define ECHO_IOC_RECV_BATCH	_IOWR(ECHO_IOC_MAGIC, 0x06, struct echo_batch)
+
+/*
+ * States of the device. While draining, writes fail with EBUSY and reads
+ * take what is left in the queues, returning 0 once they are empty.
+ */
+#define ECHO_STATE_DISABLED	0
+#define ECHO_STATE_ENABLED	1
+#define ECHO_STATE_DRAINING	2
+
+struct echo_status {
+	__u32 state;		// ECHO_STATE_*
+	__u32 queued_msgs;	// in all queues
+	__u64 queued_bytes;
+};
+
+#define ECHO_IOC_ENABLE		_IO(ECHO_IOC_MAGIC, 0x07)
+/*
+ * Drains the queues for up to the given milliseconds, then waits for reads
+ * and writes in progress and frees all messages. 0 discards queued messages
+ * right away.
+ */
+#define ECHO_IOC_DISABLE	_IOW(ECHO_IOC_MAGIC, 0x08, __u32)
+#define ECHO_IOC_GET_STATUS	_IOR(ECHO_IOC_MAGIC, 0x09, struct echo_status)
+
+/*
+ * cmd_op of IORING_OP_URING_CMD SQEs on /dev/echo_device. PUT stores a
+ * message like write, and GET copies the message out like read at offset 0.
+ * Both follow the read mode and write queue of the file.
+ */
+#define ECHO_URING_CMD_PUT	_IOW(ECHO_IOC_MAGIC, 0x80, struct echo_uring_cmd)
+#define ECHO_URING_CMD_GET	_IOR(ECHO_IOC_MAGIC, 0x81, struct echo_uring_cmd)
+
+/**
+ * Placed in the cmd area of the SQE
+ *
+ * With IORING_URING_CMD_FIXED in uring_cmd_flags, addr is inside the
+ * registered buffer selected by buf_index. The CQE res is the number of bytes
+ * copied, or a negative errno.
+ */
+struct echo_uring_cmd {
+	__u64 addr;
+	__u32 len;
+	__u32 reserved; // must be 0
+};
+
+#endif /* ECHO_UAPI_H */
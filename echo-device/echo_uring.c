@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * io_uring commands for the echo device
+ *
+ * ECHO_URING_CMD_PUT and ECHO_URING_CMD_GET from echo_uapi.h do what write and
+ * read do, so a batch of messages is one io_uring_enter instead of a syscall
+ * and fd lookup each. With IORING_URING_CMD_FIXED the user buffer is a
+ * registered one, which is already pinned and mapped.
+ *
+ * Commands complete inline, so their CQEs are posted by the submitting task
+ * without a trip through io-wq. GET reads the way the file's read mode says.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/io_uring/cmd.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include "echo_module.h"
+#include "echo_uapi.h"
+
+static int echo_uring_import(struct io_uring_cmd *ioucmd, u64 addr, u32 len,
+			     int rw, struct iov_iter *iter,
+			     unsigned int issue_flags)
+{
+	if (ioucmd->flags & IORING_URING_CMD_FIXED)
+		return io_uring_cmd_import_fixed(addr, len, rw, iter, ioucmd,
+						 issue_flags);
+
+	return import_ubuf(rw, u64_to_user_ptr(addr), len, iter);
+}
+
+/*
+ * Queue commands can block on an empty or full queue. That is never done
+ * inline, so io_uring retries them from io-wq on -EAGAIN instead.
+ */
+static int echo_uring_queue_put(struct io_uring_cmd *ioucmd, u64 addr,
+				u32 len, u32 tag, unsigned int issue_flags)
+{
+	struct echo_msg *msg;
+	struct iov_iter iter;
+	int ret;
+
+	msg = echo_msg_alloc(tag, len);
+	if (IS_ERR(msg))
+		return PTR_ERR(msg);
+
+	ret = echo_uring_import(ioucmd, addr, len, ITER_SOURCE, &iter,
+				issue_flags);
+	if (ret)
+		goto free;
+
+	if (copy_from_iter(msg->data, len, &iter) != len) {
+		ret = -EFAULT;
+		goto free;
+	}
+
+	ret = echo_queue_put(msg, issue_flags & IO_URING_F_NONBLOCK);
+	if (ret)
+		goto free;
+
+	return len;
+
+free:
+	kfree(msg);
+	return ret;
+}
+
+static int echo_uring_queue_get(struct io_uring_cmd *ioucmd, u64 addr,
+				u32 len, unsigned int issue_flags)
+{
+	struct echo_msg *msg;
+	struct iov_iter iter;
+	int ret;
+
+	msg = echo_queue_get(issue_flags & IO_URING_F_NONBLOCK);
+	if (IS_ERR_OR_NULL(msg))
+		return PTR_ERR_OR_ZERO(msg);
+
+	len = min_t(u32, msg->len, len);
+
+	ret = echo_uring_import(ioucmd, addr, len, ITER_DEST, &iter,
+				issue_flags);
+	if (!ret && copy_to_iter(msg->data, len, &iter) != len)
+		ret = -EFAULT;
+
+	kfree(msg);
+
+	return ret ? ret : len;
+}
+
+static int echo_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+	const struct echo_uring_cmd *cmd = io_uring_sqe_cmd(ioucmd->sqe);
+	struct echo_file *ef = ioucmd->file->private_data;
+	char message[BUF_SIZE];
+	struct iov_iter iter;
+	ssize_t ret;
+	u32 len, tag, mode;
+	u64 addr;
+
+	// The SQE is shared with userspace, so each field is read only once
+	addr = READ_ONCE(cmd->addr);
+	len = READ_ONCE(cmd->len);
+	if (READ_ONCE(cmd->reserved))
+		return -EINVAL;
+
+	switch (ioucmd->cmd_op) {
+	case ECHO_URING_CMD_PUT:
+		if (!echo_enabled())
+			return -EBUSY;
+
+		tag = READ_ONCE(ef->write_tag);
+		if (tag)
+			return echo_uring_queue_put(ioucmd, addr, len, tag,
+						    issue_flags);
+
+		len = min_t(u32, BUF_SIZE - 1, len);
+
+		ret = echo_uring_import(ioucmd, addr, len, ITER_SOURCE, &iter,
+					issue_flags);
+		if (ret)
+			return ret;
+
+		if (copy_from_iter(message, len, &iter) != len)
+			return -EFAULT;
+
+		return echo_put(message, len);
+	case ECHO_URING_CMD_GET:
+		mode = READ_ONCE(ef->read_mode);
+		if (mode == ECHO_READ_QUEUE)
+			return echo_uring_queue_get(ioucmd, addr, len,
+						    issue_flags);
+
+		ret = echo_get(message, mode == ECHO_READ_LOCAL);
+		if (ret < 0)
+			return ret;
+
+		len = min_t(u32, ret, len);
+
+		ret = echo_uring_import(ioucmd, addr, len, ITER_DEST, &iter,
+					issue_flags);
+		if (ret)
+			return ret;
+
+		if (copy_to_iter(message, len, &iter) != len)
+			return -EFAULT;
+
+		return len;
+	default:
+		return -ENOTTY;
+	}
+}
+
+int echo_cdev_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+	int ret;
+
+	// A disable in progress is waited for from io-wq too
+	if (!echo_op_begin(issue_flags & IO_URING_F_NONBLOCK))
+		return -EAGAIN;
+
+	ret = echo_uring_cmd(ioucmd, issue_flags);
+
+	echo_op_end();
+
+	return ret;
+}
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-3.0
+/*
+ * Compares the io_uring command path of the echo device with read/write
+ *
+ * Both paths move the same number of messages. The read/write path does a
+ * pwrite and a pread per message. The io_uring path queues batch PUT/GET
+ * pairs, submits them with one io_uring_enter and reaps the completions,
+ * using a registered buffer unless -r is given.
+ *
+ * Uses the raw io_uring syscalls, so it builds without liburing. Build with
+ * `make bench`.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include "echo_uapi.h"
+
+#define DEFAULT_MESSAGES	1000000
+#define DEFAULT_BATCH		32
+#define MAX_BATCH		256
+#define MSG_SIZE		64 // per slot of the registered buffer
+
+struct ring {
+	int fd;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int ring_init(struct ring *r, unsigned int entries)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	// Newer kernels map both rings with the SQ ring offset
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+		cq_size = sq_size;
+	}
+
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return -errno;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			return -errno;
+	}
+
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		return -errno;
+
+	r->sq_tail = sq + p.sq_off.tail;
+	r->sq_mask = sq + p.sq_off.ring_mask;
+	r->sq_array = sq + p.sq_off.array;
+	r->cq_head = cq + p.cq_off.head;
+	r->cq_tail = cq + p.cq_off.tail;
+	r->cq_mask = cq + p.cq_off.ring_mask;
+	r->cqes = cq + p.cq_off.cqes;
+
+	return 0;
+}
+
+static void ring_queue_cmd(struct ring *r, unsigned int *tail, int dev_fd,
+			   uint32_t op, void *buf, uint32_t len, int fixed)
+{
+	unsigned int idx = *tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+	struct echo_uring_cmd cmd = {
+		.addr = (uintptr_t)buf,
+		.len = len,
+	};
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = dev_fd;
+	sqe->cmd_op = op;
+	if (fixed) {
+		sqe->uring_cmd_flags = IORING_URING_CMD_FIXED;
+		sqe->buf_index = 0;
+	}
+	memcpy(sqe->cmd, &cmd, sizeof(cmd));
+
+	r->sq_array[idx] = idx;
+	(*tail)++;
+}
+
+// Submits count queued commands and waits for all their completions
+static int ring_submit_wait(struct ring *r, unsigned int tail,
+			    unsigned int count)
+{
+	unsigned int head, seen = 0;
+	int ret;
+
+	__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+	ret = syscall(__NR_io_uring_enter, r->fd, count, count,
+		      IORING_ENTER_GETEVENTS, NULL, 0);
+	if (ret < 0)
+		return -errno;
+
+	head = *r->cq_head;
+	while (seen < count) {
+		if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+			continue; // all were waited for, so this is brief
+
+		ret = r->cqes[head & *r->cq_mask].res;
+		if (ret < 0)
+			return ret;
+
+		head++;
+		seen++;
+	}
+
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int bench_rw(int fd, unsigned int messages, size_t size)
+{
+	char msg[MSG_SIZE], buf[MSG_SIZE];
+	unsigned int i;
+
+	memset(msg, 'a', size);
+
+	for (i = 0; i < messages; i++)
+		if (pwrite(fd, msg, size, 0) < 0 ||
+		    pread(fd, buf, sizeof(buf), 0) < 0)
+			return -errno;
+
+	return 0;
+}
+
+static int bench_uring(int fd, unsigned int messages, unsigned int batch,
+		       size_t size, int fixed)
+{
+	struct ring r;
+	struct iovec iov;
+	unsigned int tail, i, n, done;
+	char *slots;
+	int ret;
+
+	ret = ring_init(&r, batch * 2);
+	if (ret)
+		return ret;
+
+	// PUT messages in the first batch slots, GET into the second batch
+	iov.iov_len = (size_t)batch * 2 * MSG_SIZE;
+	iov.iov_base = aligned_alloc(4096, iov.iov_len);
+	if (!iov.iov_base)
+		return -ENOMEM;
+	slots = iov.iov_base;
+	memset(slots, 'a', iov.iov_len);
+
+	if (fixed && syscall(__NR_io_uring_register, r.fd,
+			     IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	tail = *r.sq_tail;
+
+	for (done = 0; done < messages; done += n) {
+		n = messages - done < batch ? messages - done : batch;
+
+		for (i = 0; i < n; i++) {
+			ring_queue_cmd(&r, &tail, fd, ECHO_URING_CMD_PUT,
+				       slots + i * MSG_SIZE, size, fixed);
+			ring_queue_cmd(&r, &tail, fd, ECHO_URING_CMD_GET,
+				       slots + (batch + i) * MSG_SIZE, MSG_SIZE,
+				       fixed);
+		}
+
+		ret = ring_submit_wait(&r, tail, n * 2);
+		if (ret)
+			goto out;
+	}
+
+out:
+	close(r.fd);
+	free(iov.iov_base);
+
+	return ret;
+}
+
+static void report(const char *name, unsigned int messages, uint64_t ns)
+{
+	printf("%-14s %10.0f msgs/s  %8.1f ns/msg\n", name,
+	       messages / (ns / 1e9), (double)ns / messages);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n messages] [-b batch] [-s size] [-r] device\n"
+		"  -r  plain user buffers instead of a registered buffer\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int messages = DEFAULT_MESSAGES;
+	unsigned int batch = DEFAULT_BATCH;
+	size_t size = MSG_SIZE;
+	int fixed = 1;
+	uint64_t start;
+	int fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:b:s:r")) != -1) {
+		switch (opt) {
+		case 'n':
+			messages = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			fixed = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || !messages || !batch || batch > MAX_BATCH ||
+	    !size || size > MSG_SIZE) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	start = now_ns();
+	ret = bench_rw(fd, messages, size);
+	if (ret) {
+		fprintf(stderr, "read/write: %s\n", strerror(-ret));
+		return 1;
+	}
+	report("read/write", messages, now_ns() - start);
+
+	start = now_ns();
+	ret = bench_uring(fd, messages, batch, size, fixed);
+	if (ret) {
+		fprintf(stderr, "io_uring: %s\n", strerror(-ret));
+		return 1;
+	}
+	report(fixed ? "io_uring fixed" : "io_uring", messages,
+	       now_ns() - start);
+
+	close(fd);
+
+	return 0;
+}
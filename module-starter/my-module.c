@@ -1,21 +1,595 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Microbenchmarks of the kernel primitives the other projects use
+ *
+ * Each benchmark times a loop of one primitive with get_cycles() on every
+ * online CPU, and reports the min, average and max cycles per op across
+ * CPUs. By default CPUs run one at a time, giving the uncontended cost. With
+ * parallel set they all run at once, so shared data is fought over while
+ * per-CPU data isn't.
+ *
+ * Runs at load time, and again on every write to
+ * /sys/kernel/debug/my_module/run. The last report is in results.
+ */
 
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/debugfs.h>
+#include <linux/timex.h>
+#include <linux/cpu.h>
+#include <linux/smp.h>
+#include <linux/percpu.h>
+#include <linux/atomic.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/mman.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
+
+#define REPORT_SIZE		4096
+// Work dispatch sleeps every op, so it gets fewer iterations
+#define SLOW_ITERATIONS		1000
+// How long a parallel run waits for every CPU to start before giving up
+#define START_TIMEOUT_MS	100
+// Largest copy_to_user size, and the size of the user buffer
+#define COPY_MAX_SIZE		65536
+
+static bool run_on_load = true;
+module_param(run_on_load, bool, 0444);
+MODULE_PARM_DESC(run_on_load, "Run the benchmarks when the module is loaded");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0644);
+MODULE_PARM_DESC(iterations, "Ops timed per benchmark and CPU");
+
+static bool parallel;
+module_param(parallel, bool, 0644);
+MODULE_PARM_DESC(parallel, "Run every CPU at once instead of one at a time");
+
+// The data being benchmarked, shared by all CPUs unless per-CPU
+static DEFINE_MUTEX(shared_mutex);
+static DEFINE_SPINLOCK(shared_spinlock);
+static DEFINE_SEQLOCK(shared_seqlock);
+static int shared_seq_value;
+static int shared_rcu_value;
+static int __rcu *shared_rcu_ptr;
+static atomic_t shared_atomic;
+static DEFINE_PER_CPU(atomic_t, percpu_atomic);
+// Results are added to this so the loops aren't optimized out
+static int sink;
+
+/**
+ * State of one CPU in a run
+ *
+ * run_work runs the benchmark on the CPU in parallel mode. sched_work,
+ * sched_start and sched_done time schedule_work, and timer hrtimer_start.
+ */
+struct bench_cpu {
+	struct work_struct run_work;
+	struct work_struct sched_work;
+	cycles_t sched_start;
+	u64 sched_cycles;
+	struct completion sched_done;
+	struct hrtimer timer;
+	u64 cycles; // of the last run
+};
+
+struct bench {
+	const char *name;
+	// Returns the cycles taken by n ops
+	u64 (*fn)(struct bench_cpu *bc, unsigned int n);
+	bool slow;
+};
+
+static struct bench_cpu *bench_cpus; // indexed by CPU
+static const struct bench *current_bench; // set for the length of a run
+static unsigned int current_iterations;
+static struct workqueue_struct *bench_wq; // runs the parallel benchmarks
+static atomic_t waiting; // CPUs yet to reach the start of a parallel run
+static bool start_timed_out; // of the current parallel run
+
+static struct dentry *debugfs_dir;
+static DEFINE_MUTEX(run_lock); // protects report and serializes runs
+static char *report;
+static size_t report_len;
+
+static u64 bench_mutex(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		mutex_lock(&shared_mutex);
+		mutex_unlock(&shared_mutex);
+	}
+
+	return get_cycles() - start;
+}
+
+static u64 bench_spinlock(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		spin_lock(&shared_spinlock);
+		spin_unlock(&shared_spinlock);
+	}
+
+	return get_cycles() - start;
+}
+
+static u64 bench_seqlock_read(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i, seq;
+	int sum = 0, val;
+
+	for (i = 0; i < n; i++) {
+		do {
+			seq = read_seqbegin(&shared_seqlock);
+			val = READ_ONCE(shared_seq_value);
+		} while (read_seqretry(&shared_seqlock, seq));
+		sum += val;
+	}
+
+	WRITE_ONCE(sink, sum);
+
+	return get_cycles() - start;
+}
+
+static u64 bench_rcu_read(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+	int sum = 0;
+
+	for (i = 0; i < n; i++) {
+		rcu_read_lock();
+		sum += *rcu_dereference(shared_rcu_ptr);
+		rcu_read_unlock();
+	}
+
+	WRITE_ONCE(sink, sum);
+
+	return get_cycles() - start;
+}
+
+static u64 bench_atomic_read(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+	int sum = 0;
+
+	for (i = 0; i < n; i++)
+		sum += atomic_read(&shared_atomic);
+
+	WRITE_ONCE(sink, sum);
+
+	return get_cycles() - start;
+}
+
+static u64 bench_atomic_set(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		atomic_set(&shared_atomic, i);
+
+	return get_cycles() - start;
+}
+
+// Benchmarks run on a thread bound to the CPU, so this_cpu_ptr is stable
+static u64 bench_percpu_atomic_read(struct bench_cpu *bc, unsigned int n)
+{
+	atomic_t *a = this_cpu_ptr(&percpu_atomic);
+	cycles_t start = get_cycles();
+	unsigned int i;
+	int sum = 0;
+
+	for (i = 0; i < n; i++)
+		sum += atomic_read(a);
+
+	WRITE_ONCE(sink, sum);
+
+	return get_cycles() - start;
+}
+
+static u64 bench_percpu_atomic_set(struct bench_cpu *bc, unsigned int n)
+{
+	atomic_t *a = this_cpu_ptr(&percpu_atomic);
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		atomic_set(a, i);
+
+	return get_cycles() - start;
+}
+
+static void sched_work_fn(struct work_struct *work)
+{
+	struct bench_cpu *bc = container_of(work, struct bench_cpu,
+					    sched_work);
+
+	bc->sched_cycles += get_cycles() - bc->sched_start;
+	complete(&bc->sched_done);
+}
+
+// Time from schedule_work until the work starts running
+static u64 bench_schedule_work(struct bench_cpu *bc, unsigned int n)
+{
+	unsigned int i;
+
+	bc->sched_cycles = 0;
+
+	for (i = 0; i < n; i++) {
+		reinit_completion(&bc->sched_done);
+		bc->sched_start = get_cycles();
+		schedule_work(&bc->sched_work);
+		wait_for_completion(&bc->sched_done);
+	}
+
+	return bc->sched_cycles;
+}
+
+static enum hrtimer_restart bench_timer_callback(struct hrtimer *timer)
+{
+	return HRTIMER_NORESTART;
+}
+
+// The timer is far enough out that it is always cancelled before firing
+static u64 bench_hrtimer(struct bench_cpu *bc, unsigned int n)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		hrtimer_start(&bc->timer, ms_to_ktime(1000), HRTIMER_MODE_REL);
+		hrtimer_cancel(&bc->timer);
+	}
+
+	return get_cycles() - start;
+}
+
+static const struct bench benches[] = {
+	{ "mutex lock/unlock", bench_mutex },
+	{ "spinlock lock/unlock", bench_spinlock },
+	{ "seqlock read", bench_seqlock_read },
+	{ "rcu read", bench_rcu_read },
+	{ "atomic_read shared", bench_atomic_read },
+	{ "atomic_set shared", bench_atomic_set },
+	{ "atomic_read per-cpu", bench_percpu_atomic_read },
+	{ "atomic_set per-cpu", bench_percpu_atomic_set },
+	{ "schedule_work latency", bench_schedule_work, true },
+	{ "hrtimer start/cancel", bench_hrtimer },
+};
+
+static unsigned int bench_iterations(const struct bench *bench,
+				     unsigned int n)
+{
+	return bench->slow ? min_t(unsigned int, n, SLOW_ITERATIONS) : n;
+}
+
+// Runs the current benchmark on the calling CPU
+static int bench_on_cpu(void *data)
+{
+	struct bench_cpu *bc = data;
+
+	bc->cycles = current_bench->fn(bc, current_iterations);
+
+	return 0;
+}
+
+/*
+ * Parallel runs wait for every CPU before starting, so they all overlap.
+ *
+ * The wait spins, since sleeping would let the CPUs start at different
+ * times. It gives up after START_TIMEOUT_MS, e.g. if a CPU's worker is held
+ * up behind something that doesn't preempt, and the run is reported as
+ * aborted. CPUs that get here after that don't run either.
+ */
+static void bench_run_work(struct work_struct *work)
+{
+	struct bench_cpu *bc = container_of(work, struct bench_cpu, run_work);
+	u64 deadline = ktime_get_ns() + START_TIMEOUT_MS * NSEC_PER_MSEC;
+
+	atomic_dec(&waiting);
+	while (atomic_read(&waiting) && !READ_ONCE(start_timed_out)) {
+		if (ktime_get_ns() > deadline)
+			WRITE_ONCE(start_timed_out, true);
+		cpu_relax();
+	}
+
+	if (READ_ONCE(start_timed_out))
+		return;
+
+	bench_on_cpu(bc);
+}
+
+static __printf(1, 2) void report_add(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	report_len += vscnprintf(report + report_len,
+				 REPORT_SIZE - report_len, fmt, args);
+	va_end(args);
+}
+
+/*
+ * Cycles per op in thousandths. On arm64 get_cycles() counts system counter
+ * ticks of tens of ns, which fast ops take only a fraction of.
+ */
+static u64 per_op_milli(u64 cycles, unsigned int n)
+{
+	return div_u64(cycles * 1000, n);
+}
+
+// Adds a value in thousandths as " x.yyy", 11 characters wide
+static void report_milli(u64 milli)
+{
+	u32 frac;
+	u64 whole = div_u64_rem(milli, 1000, &frac);
+
+	report_add(" %6llu.%03u", whole, frac);
+}
+
+// Runs one benchmark on every online CPU and adds its line to the report
+static void run_bench(const struct bench *bench, unsigned int n)
+{
+	u64 min_op = U64_MAX, max_op = 0, total = 0;
+	unsigned int cpus = 0;
+	int cpu;
+
+	current_bench = bench;
+	current_iterations = bench_iterations(bench, n);
+
+	cpus_read_lock();
+
+	if (parallel) {
+		WRITE_ONCE(start_timed_out, false);
+		atomic_set(&waiting, num_online_cpus());
+		for_each_online_cpu(cpu)
+			queue_work_on(cpu, bench_wq, &bench_cpus[cpu].run_work);
+		for_each_online_cpu(cpu)
+			flush_work(&bench_cpus[cpu].run_work);
+
+		if (start_timed_out) {
+			cpus_read_unlock();
+			report_add("%-24s aborted, not every cpu started within %dms\n",
+				   bench->name, START_TIMEOUT_MS);
+			return;
+		}
+	} else {
+		for_each_online_cpu(cpu)
+			smp_call_on_cpu(cpu, bench_on_cpu, &bench_cpus[cpu],
+					false);
+	}
+
+	for_each_online_cpu(cpu) {
+		u64 per_op = per_op_milli(bench_cpus[cpu].cycles,
+					  current_iterations);
+
+		min_op = min(min_op, per_op);
+		max_op = max(max_op, per_op);
+		total += per_op;
+		cpus++;
+	}
+
+	cpus_read_unlock();
+
+	report_add("%-24s", bench->name);
+	report_milli(min_op);
+	report_milli(div_u64(total, cpus));
+	report_milli(max_op);
+	report_add("\n");
+}
+
+/*
+ * Times copy_to_user into an anonymous mapping of the calling process, so
+ * it only runs on the calling CPU. The first copy faults the pages in and
+ * isn't timed.
+ */
+static void run_copy_to_user(void *kbuf, unsigned int iters)
+{
+	static const unsigned int sizes[] = { 64, 256, 1024, 4096, 16384,
+					      COPY_MAX_SIZE };
+	unsigned long ubuf;
+	unsigned int i, j, n;
+	cycles_t start;
+	u64 cycles;
+
+	if (!current->mm) {
+		report_add("copy_to_user skipped, no user address space\n");
+		return;
+	}
+
+	ubuf = vm_mmap(NULL, 0, COPY_MAX_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, 0);
+	if (IS_ERR_VALUE(ubuf)) {
+		report_add("copy_to_user skipped, mmap failed\n");
+		return;
+	}
+
+	if (copy_to_user((void __user *)ubuf, kbuf, COPY_MAX_SIZE)) {
+		report_add("copy_to_user skipped, fault in failed\n");
+		goto unmap;
+	}
+
+	report_add("\ncopy_to_user on cpu %d     cycles/op\n",
+		   raw_smp_processor_id());
+
+	n = min_t(unsigned int, iters, SLOW_ITERATIONS * 10);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		start = get_cycles();
+		for (j = 0; j < n; j++)
+			if (copy_to_user((void __user *)ubuf, kbuf, sizes[i]))
+				break;
+		cycles = get_cycles() - start;
+
+		report_add("%6u bytes%14s", sizes[i], "");
+		report_milli(per_op_milli(cycles, n));
+		report_add("\n");
+	}
+
+unmap:
+	vm_munmap(ubuf, COPY_MAX_SIZE);
+}
+
+/*
+ * Runs every benchmark and replaces the report.
+ *
+ * iterations can be written through debugfs at any time, so it is read once
+ * and that count is used for the whole run.
+ */
+static int run_all(void)
+{
+	unsigned int n;
+	void *kbuf;
+	int i, ret = 0;
+
+	kbuf = kzalloc(COPY_MAX_SIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&run_lock);
+
+	n = READ_ONCE(iterations);
+	if (!n) {
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	report_len = 0;
+	report_add("%u iterations, %s, cycles/op across %u cpus\n",
+		   n, parallel ? "parallel" : "one cpu at a time",
+		   num_online_cpus());
+	report_add("%-24s %10s %10s %10s\n", "", "min", "avg", "max");
+
+	for (i = 0; i < ARRAY_SIZE(benches); i++)
+		run_bench(&benches[i], n);
+
+	run_copy_to_user(kbuf, n);
+
+unlock:
+	mutex_unlock(&run_lock);
+
+	kfree(kbuf);
+
+	return ret;
+}
+
+// Any write starts a run, and returns once it is done
+static ssize_t run_write(struct file *file, const char __user *buf,
+			 size_t count, loff_t *pos)
+{
+	int ret;
+
+	ret = run_all();
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static const struct file_operations run_fops = {
+	.owner = THIS_MODULE,
+	.write = run_write,
+};
+
+static ssize_t results_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *pos)
+{
+	ssize_t ret;
+
+	mutex_lock(&run_lock);
+	ret = simple_read_from_buffer(buf, count, pos, report, report_len);
+	mutex_unlock(&run_lock);
+
+	return ret;
+}
+
+static const struct file_operations results_fops = {
+	.owner = THIS_MODULE,
+	.read = results_read,
+};
 
 static int __init my_module_init(void)
 {
-	pr_info("Hello, World!\n");
+	int cpu;
+
+	report = kzalloc(REPORT_SIZE, GFP_KERNEL);
+	if (!report)
+		return -ENOMEM;
+
+	bench_cpus = kcalloc(nr_cpu_ids, sizeof(*bench_cpus), GFP_KERNEL);
+	if (!bench_cpus)
+		goto report_err;
+
+	/*
+	 * CPU intensive work doesn't count for concurrency management, so
+	 * other work queued on the same CPUs still gets a worker while the
+	 * start spins
+	 */
+	bench_wq = alloc_workqueue("my_module_bench",
+				   WQ_HIGHPRI | WQ_CPU_INTENSIVE, 0);
+	if (!bench_wq)
+		goto cpus_err;
+
+	for_each_possible_cpu(cpu) {
+		struct bench_cpu *bc = &bench_cpus[cpu];
+
+		INIT_WORK(&bc->run_work, bench_run_work);
+		INIT_WORK(&bc->sched_work, sched_work_fn);
+		init_completion(&bc->sched_done);
+		hrtimer_setup(&bc->timer, bench_timer_callback, CLOCK_MONOTONIC,
+			      HRTIMER_MODE_REL);
+	}
+
+	RCU_INIT_POINTER(shared_rcu_ptr, &shared_rcu_value);
+
+	// The benchmarks work without debugfs, so its errors are ignored
+	debugfs_dir = debugfs_create_dir("my_module", NULL);
+	debugfs_create_file("run", 0200, debugfs_dir, NULL, &run_fops);
+	debugfs_create_file("results", 0444, debugfs_dir, NULL, &results_fops);
+	debugfs_create_u32("iterations", 0644, debugfs_dir, &iterations);
+	debugfs_create_bool("parallel", 0644, debugfs_dir, &parallel);
+
+	if (run_on_load && !run_all())
+		pr_info("my_module: benchmark results\n%s", report);
+
 	return 0;
+
+cpus_err:
+	kfree(bench_cpus);
+report_err:
+	kfree(report);
+	return -ENOMEM;
 }
 
 static void __exit my_module_exit(void)
 {
-	pr_info("Goodbye, World!\n");
+	debugfs_remove_recursive(debugfs_dir);
+	destroy_workqueue(bench_wq);
+	kfree(bench_cpus);
+	kfree(report);
 }
 
 module_init(my_module_init);
 module_exit(my_module_exit);
 
+MODULE_AUTHOR("Michael Harris <michaelharriscode@gmail.com>");
+MODULE_DESCRIPTION("Microbenchmarks of locking, atomics, work and timers");
 MODULE_LICENSE("GPL");
@@ -1,29 +1,113 @@
 // SPDX-License-Identifier: GPL-2.0
 
-//! Rust out-of-tree sample
+//! Rust echo device
+//!
+//! A Rust version of `../echo-device`. Writes to `/dev/rust_echo_device` store
+//! a message, and reads return the last message written.
+//!
+//! The message lives in a `SpinLock` rather than a mutex. Copies to and from
+//! userspace can fault and sleep, so they go through a stack buffer and the
+//! lock is only held for a memcpy of at most `BUF_SIZE` bytes.
 
-use kernel::prelude::*;
+use kernel::{
+    c_str,
+    fs::{File, Kiocb},
+    iov::{IovIterDest, IovIterSource},
+    miscdevice::{MiscDevice, MiscDeviceOptions, MiscDeviceRegistration},
+    prelude::*,
+};
 
 module! {
     type: RustModuleStarter,
     name: "my_rust",
-    author: "Michael Harris <michaelharriscode@gmail.com>",
-    description: "This is my rust module starter",
+    authors: ["Michael Harris <michaelharriscode@gmail.com>"],
+    description: "Echo stored data back to user, in Rust",
     license: "GPL",
 }
 
-struct RustModuleStarter; 
+/// Same size as the C version, so both keep at most 255 bytes
+const BUF_SIZE: usize = 256;
 
-impl kernel::Module for RustModuleStarter {
-    fn init(_module: &'static ThisModule) -> Result<Self> {
-        pr_info!("Rust Module Starter: Initialized!\n");
+/// The last message written, shared by every open file
+struct Message {
+    len: usize,
+    data: [u8; BUF_SIZE],
+}
+
+kernel::sync::global_lock! {
+    // SAFETY: Initialized in `init` before the device is registered.
+    unsafe(uninit) static MESSAGE: SpinLock<Message> = Message {
+        len: 0,
+        data: [0; BUF_SIZE],
+    };
+}
+
+#[pin_data]
+struct RustModuleStarter {
+    #[pin]
+    _miscdev: MiscDeviceRegistration<RustEchoDevice>,
+}
+
+impl kernel::InPlaceModule for RustModuleStarter {
+    fn init(_module: &'static ThisModule) -> impl PinInit<Self, Error> {
+        // SAFETY: Called once, before anything can lock MESSAGE.
+        unsafe { MESSAGE.init() };
 
-        Ok(RustModuleStarter)
+        let options = MiscDeviceOptions {
+            name: c_str!("rust_echo_device"),
+        };
+
+        pr_info!("rust_echo_device: Initialized\n");
+
+        try_pin_init!(Self {
+            _miscdev <- MiscDeviceRegistration::register(options),
+        })
     }
 }
 
 impl Drop for RustModuleStarter {
     fn drop(&mut self) {
-        pr_info!("Rust Module Starter: DROPPED!!!!!\n");
+        pr_info!("rust_echo_device: Exited\n");
+    }
+}
+
+/// Open files keep no state of their own, the message is in MESSAGE
+struct RustEchoDevice;
+
+#[vtable]
+impl MiscDevice for RustEchoDevice {
+    type Ptr = ();
+
+    fn open(_file: &File, _misc: &MiscDeviceRegistration<Self>) -> Result {
+        Ok(())
+    }
+
+    fn read_iter(mut kiocb: Kiocb<'_, Self::Ptr>, iov: &mut IovIterDest<'_>) -> Result<usize> {
+        let mut buf = [0u8; BUF_SIZE];
+
+        let len = {
+            let message = MESSAGE.lock();
+            buf[..message.len].copy_from_slice(&message.data[..message.len]);
+            message.len
+        };
+
+        iov.simple_read_from_buffer(kiocb.ki_pos_mut(), &buf[..len])
+    }
+
+    // Keeps the first BUF_SIZE - 1 bytes, like the C version
+    fn write_iter(_kiocb: Kiocb<'_, Self::Ptr>, iov: &mut IovIterSource<'_>) -> Result<usize> {
+        let mut buf = [0u8; BUF_SIZE];
+        let want = iov.len().min(BUF_SIZE - 1);
+
+        let len = iov.copy_from_iter(&mut buf[..want]);
+        if len < want {
+            return Err(EFAULT);
+        }
+
+        let mut message = MESSAGE.lock();
+        message.data[..len].copy_from_slice(&buf[..len]);
+        message.len = len;
+
+        Ok(len)
     }
 }
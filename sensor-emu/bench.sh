@@ -0,0 +1,164 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Measures the bmp280 and tsl2561 drivers on the sensor_emu adapter, for each
+# driver mode: samples per second, bus transfers per sample and the latency of
+# a sysfs read. Needs sensor_emu, sensor_poll, bmp280 and tsl2561 loaded, and
+# debugfs mounted. Runs as root, in the QEMU guest of qemu-run.sh or on any
+# machine with the modules built for it.
+#
+# DURATION is how long each mode is measured for, in seconds.
+
+DURATION=${DURATION:-5}
+EMU=/sys/kernel/debug/sensor_emu
+
+BUS=
+for d in /sys/bus/i2c/devices/i2c-*; do
+	if [ "$(cat "$d/name")" = sensor-emu ]; then
+		BUS=${d##*-}
+	fi
+done
+
+if [ -z "$BUS" ] || [ ! -d "$EMU" ]; then
+	echo "sensor_emu isn't loaded, or debugfs isn't mounted" >&2
+	exit 1
+fi
+
+echo bmp280 0x76 > "/sys/bus/i2c/devices/i2c-$BUS/new_device"
+echo tsl2561 0x39 > "/sys/bus/i2c/devices/i2c-$BUS/new_device"
+sleep 1
+
+BMP=$(ls -d /sys/class/bmp280/bmp280* | head -n 1)
+BMP_DEV=/dev/${BMP##*/}
+
+TSL=
+for d in /sys/bus/iio/devices/iio:device*; do
+	if [ "$(cat "$d/name")" = tsl2561 ]; then
+		TSL=$d
+	fi
+done
+TSL_DEV=/dev/${TSL##*/}
+
+now_ns() {
+	date +%s%N
+}
+
+# Average time of a sysfs read in microseconds, read with the shell builtin
+# so no process is started per read
+latency_us() {
+	file=$1
+	n=$2
+	i=0
+	t0=$(now_ns)
+	while [ $i -lt "$n" ]; do
+		read -r _ < "$file"
+		i=$((i + 1))
+	done
+	t1=$(now_ns)
+	echo $(((t1 - t0) / n / 1000))
+}
+
+# Counts samples from poll_stats and transfers from the emulator over
+# DURATION seconds, into RATE and XFERS
+measure() {
+	stats=$1
+	chip=$2
+
+	s0=$(cat "$stats/samples")
+	x0=$(cat "$chip/xfers")
+	t0=$(now_ns)
+	sleep "$DURATION"
+	s1=$(cat "$stats/samples")
+	x1=$(cat "$chip/xfers")
+	t1=$(now_ns)
+
+	samples=$((s1 - s0))
+	ms=$(((t1 - t0) / 1000000))
+	RATE=$((samples * 1000 / ms))
+	if [ $samples -gt 0 ]; then
+		x=$(((x1 - x0) * 100 / samples))
+		XFERS=$(printf '%d.%02d' $((x / 100)) $((x % 100)))
+	else
+		XFERS=-
+	fi
+}
+
+report() {
+	printf '%-32s %10s %14s %14s\n' "$1" "$2" "$3" "$4"
+}
+
+# mode, temperature and pressure oversampling, poll interval in ms
+bmp280_mode() {
+	echo "$1" > "$BMP/mode"
+	echo "$2" > "$BMP/oversampling_temperature"
+	echo "$3" > "$BMP/oversampling_pressure"
+	echo 500 > "$BMP/standby_time"
+	echo "$4" > "$BMP/poll_interval"
+
+	# An open char device keeps the sensor resumed and polling
+	cat "$BMP_DEV" > /dev/null &
+	reader=$!
+	sleep 1
+
+	measure "$BMP/device/poll_stats" "$EMU/bmp280-76"
+	lat=$(latency_us "$BMP/temperature" 200)
+
+	kill $reader
+	wait $reader 2> /dev/null
+
+	report "bmp280 $1 x$2/x$3 ${4}ms" "$RATE" "$XFERS" "$lat"
+}
+
+# integration time, sampling frequency of the polled buffer, sysfs reads
+tsl2561_mode() {
+	echo "$1" > "$TSL/in_illuminance_integration_time"
+
+	lat=$(latency_us "$TSL/in_illuminance_broadband_raw" "$3")
+
+	echo > "$TSL/trigger/current_trigger" 2> /dev/null
+	echo "$2" > "$TSL/sampling_frequency"
+	echo 1 > "$TSL/scan_elements/in_illuminance_broadband_en"
+	echo 1 > "$TSL/scan_elements/in_illuminance_ir_en"
+	echo 1 > "$TSL/scan_elements/in_timestamp_en"
+
+	# Manual windows can't run from the polling core, so those only get
+	# the sysfs latency
+	if echo 1 2> /dev/null > "$TSL/buffer/enable"; then
+		cat "$TSL_DEV" > /dev/null &
+		reader=$!
+		sleep 1
+
+		measure "$TSL/../poll_stats" "$EMU/tsl2561-39"
+
+		kill $reader
+		wait $reader 2> /dev/null
+		echo 0 > "$TSL/buffer/enable"
+	else
+		RATE=-
+		XFERS=-
+	fi
+
+	report "tsl2561 ${1}ms ${2}Hz" "$RATE" "$XFERS" "$lat"
+}
+
+echo "bus i2c-$BUS at $(cat /sys/module/sensor_emu/parameters/bus_khz) kHz," \
+     "${DURATION}s per mode"
+report mode samples/s xfers/sample sysfs_read_us
+
+if [ -d "$BMP" ]; then
+	bmp280_mode forced 1 1 5
+	bmp280_mode forced 16 16 100
+	bmp280_mode normal 1 1 5
+	bmp280_mode normal 16 16 100
+else
+	echo "no bmp280 device" >&2
+fi
+
+if [ -n "$TSL" ]; then
+	tsl2561_mode 13 71 20
+	tsl2561_mode 101 9 5
+	tsl2561_mode 402 2 3
+	tsl2561_mode 0.5 71 20
+else
+	echo "no tsl2561 device" >&2
+fi
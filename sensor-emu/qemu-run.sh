@@ -0,0 +1,72 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Boots the kernel built in KDIR in QEMU with an initramfs holding busybox,
+# the modules and bench.sh, runs the benchmark and powers off. The modules
+# have to be built against KDIR first, `make qemu KDIR=...` does both.
+#
+# Usage: ./qemu-run.sh <kernel build dir>
+#
+# BUSYBOX is a statically linked busybox, found in PATH by default. DURATION
+# is passed on to bench.sh.
+
+set -e
+
+KDIR=${1:?usage: $0 <kernel build dir>}
+KERNEL=${KERNEL:-$KDIR/arch/x86/boot/bzImage}
+BUSYBOX=${BUSYBOX:-$(command -v busybox)}
+DURATION=${DURATION:-5}
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/.." && pwd)
+
+for f in "$KERNEL" "$BUSYBOX" \
+	 "$HERE/sensor_emu.ko" "$ROOT/sensor-poll/sensor_poll.ko" \
+	 "$ROOT/bmp280-driver/bmp280.ko" "$ROOT/tsl2561-iio-driver/tsl2561.ko"; do
+	if [ ! -f "$f" ]; then
+		echo "missing $f" >&2
+		exit 1
+	fi
+done
+
+INITRAMFS=$(mktemp -d)
+trap 'rm -rf "$INITRAMFS" "$INITRAMFS.cpio.gz"' EXIT
+
+mkdir -p "$INITRAMFS/bin" "$INITRAMFS/modules" "$INITRAMFS/proc" \
+	 "$INITRAMFS/sys" "$INITRAMFS/dev" "$INITRAMFS/tmp"
+cp "$BUSYBOX" "$INITRAMFS/bin/busybox"
+cp "$HERE/sensor_emu.ko" "$ROOT/sensor-poll/sensor_poll.ko" \
+   "$ROOT/bmp280-driver/bmp280.ko" "$ROOT/tsl2561-iio-driver/tsl2561.ko" \
+   "$INITRAMFS/modules/"
+cp "$HERE/bench.sh" "$INITRAMFS/bench.sh"
+
+cat > "$INITRAMFS/init" <<EOF
+#!/bin/busybox sh
+/bin/busybox --install -s /bin
+mount -t proc proc /proc
+mount -t sysfs sysfs /sys
+mount -t devtmpfs devtmpfs /dev
+mount -t debugfs debugfs /sys/kernel/debug
+mount -t tracefs tracefs /sys/kernel/tracing 2>/dev/null
+
+for m in sensor_emu sensor_poll bmp280 tsl2561; do
+	insmod /modules/\$m.ko || echo "insmod \$m failed"
+done
+
+DURATION=$DURATION sh /bench.sh
+poweroff -f
+EOF
+chmod +x "$INITRAMFS/init" "$INITRAMFS/bench.sh"
+
+(cd "$INITRAMFS" && find . | cpio -o -H newc --quiet | gzip) \
+	> "$INITRAMFS.cpio.gz"
+
+ACCEL=
+if [ -w /dev/kvm ]; then
+	ACCEL="-enable-kvm -cpu host"
+fi
+
+# shellcheck disable=SC2086
+qemu-system-x86_64 $ACCEL -m 512 -smp 2 -nographic -no-reboot \
+	-kernel "$KERNEL" -initrd "$INITRAMFS.cpio.gz" \
+	-append "console=ttyS0 panic=-1 quiet"
+
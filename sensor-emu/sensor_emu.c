@@ -0,0 +1,545 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Emulated i2c adapter with bmp280 and tsl2561 register models
+ *
+ * Unlike i2c-stub, conversions take time: the bmp280 measuring bit stays set
+ * for the datasheet's typical measurement time and the tsl2561 data registers
+ * only change at the end of an integration cycle. Every transfer is counted,
+ * so the drivers' bus traffic per sample can be measured without hardware.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/string.h>
+#include <linux/minmax.h>
+#include <linux/math64.h>
+
+#define BMP280_REG_CALIB	0x88
+#define BMP280_REG_ID		0xD0
+#define BMP280_REG_RESET	0xE0
+#define BMP280_REG_STATUS	0xF3
+#define BMP280_REG_CTRL_MEAS	0xF4
+#define BMP280_REG_CONFIG	0xF5
+#define BMP280_REG_PRESS	0xF7
+#define BMP280_REG_TEMP		0xFA
+
+#define BMP280_CHIP_ID		0x58
+#define BMP280_RESET_VALUE	0xB6
+#define BMP280_STATUS_MEASURING	0x08
+#define BMP280_MODE_MASK	0x03
+#define BMP280_MODE_SLEEP	0x00
+#define BMP280_MODE_NORMAL	0x03
+#define BMP280_ADC_SKIPPED	0x80000
+
+// Calibration and ADC example from 3.12 of the datasheet
+#define BMP280_ADC_T		519888
+#define BMP280_ADC_P		415148
+
+#define TSL2561_REG_CONTROL	0x00
+#define TSL2561_REG_TIMING	0x01
+#define TSL2561_REG_THRESH	0x02
+#define TSL2561_REG_INTERRUPT	0x06
+#define TSL2561_REG_ID		0x0A
+#define TSL2561_REG_DATA_0	0x0C
+#define TSL2561_REG_MASK	0x0F
+
+#define TSL2561_CMD_BIT		0x80
+#define TSL2561_CLEAR_BIT	0x40
+#define TSL2561_POWER_MASK	0x03
+#define TSL2561_POWER_ON	0x03
+#define TSL2561_INTEG_MASK	0x03
+#define TSL2561_INTEG_MANUAL	0x03
+#define TSL2561_MANUAL_BIT	0x08
+#define TSL2561_GAIN_BIT	0x10
+#define TSL2561_CHIP_ID		0x50 // TSL2561T, revision 0
+#define TSL2561_TIMING_RESET	0x02 // 402ms, 1x gain
+
+/*
+ * Counts per second at 1x gain, for the default light level. Gives about
+ * 1000 CH0 counts at 402ms, a ratio of 0.3 and around 30 lux.
+ */
+#define TSL2561_CH0_PER_SEC	2500
+#define TSL2561_CH1_PER_SEC	750
+
+// Light level variation over a cycle of conversions, in permille
+#define WAVE_PERIOD		128
+#define WAVE_PERMILLE		100
+
+static unsigned int bus_khz = 400;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "Emulated bus clock in kHz, 0 for transfers that take no time");
+
+enum emu_chip_type {
+	EMU_BMP280,
+	EMU_TSL2561,
+};
+
+struct emu_chip {
+	const char *name;
+	u16 addr;
+	enum emu_chip_type type;
+	u8 regs[256];
+	u8 pointer;
+
+	// Conversion state, updated on each access from the time passed
+	ktime_t start;		// of the current forced/manual conversion or cycle
+	bool converting;
+	u64 done;		// conversions latched since start
+
+	// Light level in permille of the default, tsl2561 only
+	u32 light;
+
+	// Counters in debugfs
+	u64 xfers;
+	u64 msgs;
+	u64 bytes;
+	u64 conversions;
+};
+
+static struct emu_chip emu_chips[] = {
+	{ .name = "bmp280", .addr = 0x76, .type = EMU_BMP280 },
+	{ .name = "bmp280", .addr = 0x77, .type = EMU_BMP280 },
+	{ .name = "tsl2561", .addr = 0x29, .type = EMU_TSL2561 },
+	{ .name = "tsl2561", .addr = 0x39, .type = EMU_TSL2561 },
+	{ .name = "tsl2561", .addr = 0x49, .type = EMU_TSL2561 },
+};
+
+static const u8 bmp280_calib[] = {
+	0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B,
+	0x27, 0x0B, 0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17,
+};
+
+// Standby times of the config register t_sb field (3.6.3 of the datasheet)
+static const unsigned int bmp280_standby_us[] = {
+	500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000,
+};
+
+// Nominal integration times of the tsl2561 timing register
+static const unsigned int tsl2561_integ_us[] = { 13700, 101000, 402000 };
+static const unsigned int tsl2561_saturation[] = { 5047, 37177, 65535 };
+
+static struct i2c_adapter emu_adapter;
+static struct dentry *emu_debugfs;
+
+// Triangle wave of +-WAVE_PERMILLE around 1000, so values change every sample
+static unsigned int wave(u64 n)
+{
+	unsigned int phase = n % WAVE_PERIOD;
+
+	if (phase >= WAVE_PERIOD / 2)
+		phase = WAVE_PERIOD - phase;
+
+	return 1000 - WAVE_PERMILLE + phase * 4 * WAVE_PERMILLE / WAVE_PERIOD;
+}
+
+// Oversampling count of an osrs field, 0 when the measurement is skipped
+static unsigned int bmp280_osrs(u8 field)
+{
+	return field ? 1 << (min_t(u8, field, 5) - 1) : 0;
+}
+
+// Typical measurement time from 3.8.1 of the datasheet
+static unsigned int bmp280_meas_us(struct emu_chip *chip)
+{
+	u8 ctrl_meas = chip->regs[BMP280_REG_CTRL_MEAS];
+	unsigned int osrs_t = bmp280_osrs(ctrl_meas >> 5);
+	unsigned int osrs_p = bmp280_osrs((ctrl_meas >> 2) & 0x07);
+
+	return 1000 + 2000 * (osrs_t + osrs_p) + (osrs_p ? 500 : 0);
+}
+
+static void put_adc20(u8 *reg, u32 adc)
+{
+	reg[0] = adc >> 12;
+	reg[1] = adc >> 4;
+	reg[2] = (adc << 4) & 0xF0;
+}
+
+// Latches the result of the chip's n-th conversion into the data registers
+static void bmp280_latch(struct emu_chip *chip, u64 n)
+{
+	u8 ctrl_meas = chip->regs[BMP280_REG_CTRL_MEAS];
+	unsigned int level = wave(n);
+	u32 adc_t = BMP280_ADC_T * level / 1000;
+	u32 adc_p = BMP280_ADC_P * 1000 / level;
+
+	if (!(ctrl_meas >> 5))
+		adc_t = BMP280_ADC_SKIPPED;
+	if (!((ctrl_meas >> 2) & 0x07))
+		adc_p = BMP280_ADC_SKIPPED;
+
+	put_adc20(&chip->regs[BMP280_REG_PRESS], adc_p);
+	put_adc20(&chip->regs[BMP280_REG_TEMP], adc_t);
+	chip->conversions++;
+}
+
+static void bmp280_update(struct emu_chip *chip, ktime_t now)
+{
+	u8 mode = chip->regs[BMP280_REG_CTRL_MEAS] & BMP280_MODE_MASK;
+	u64 elapsed_us = ktime_us_delta(now, chip->start);
+	unsigned int meas_us = bmp280_meas_us(chip);
+	unsigned int period_us;
+	u32 phase_us;
+	u64 n;
+
+	if (mode == BMP280_MODE_SLEEP)
+		return;
+
+	if (mode != BMP280_MODE_NORMAL) {
+		// Forced, goes back to sleep once the measurement is done
+		if (elapsed_us < meas_us)
+			return;
+
+		bmp280_latch(chip, chip->conversions);
+		chip->regs[BMP280_REG_CTRL_MEAS] &= ~BMP280_MODE_MASK;
+		chip->converting = false;
+		return;
+	}
+
+	period_us = meas_us +
+		    bmp280_standby_us[chip->regs[BMP280_REG_CONFIG] >> 5];
+
+	div_u64_rem(elapsed_us, period_us, &phase_us);
+	chip->converting = phase_us < meas_us;
+	if (elapsed_us < meas_us)
+		return;
+
+	n = div_u64(elapsed_us - meas_us, period_us) + 1;
+	if (n > chip->done) {
+		chip->done = n;
+		bmp280_latch(chip, chip->conversions);
+	}
+}
+
+static void bmp280_reset(struct emu_chip *chip)
+{
+	memset(chip->regs, 0, sizeof(chip->regs));
+	memcpy(&chip->regs[BMP280_REG_CALIB], bmp280_calib,
+	       sizeof(bmp280_calib));
+	chip->regs[BMP280_REG_ID] = BMP280_CHIP_ID;
+	put_adc20(&chip->regs[BMP280_REG_PRESS], BMP280_ADC_SKIPPED);
+	put_adc20(&chip->regs[BMP280_REG_TEMP], BMP280_ADC_SKIPPED);
+	chip->converting = false;
+}
+
+static u8 bmp280_read_reg(struct emu_chip *chip, u8 reg)
+{
+	if (reg == BMP280_REG_STATUS)
+		return chip->converting ? BMP280_STATUS_MEASURING : 0;
+
+	return chip->regs[reg];
+}
+
+static void bmp280_write_reg(struct emu_chip *chip, u8 reg, u8 val,
+			     ktime_t now)
+{
+	switch (reg) {
+	case BMP280_REG_RESET:
+		if (val == BMP280_RESET_VALUE)
+			bmp280_reset(chip);
+		break;
+	case BMP280_REG_CTRL_MEAS:
+		chip->regs[reg] = val;
+		chip->start = now;
+		chip->done = 0;
+		chip->converting = (val & BMP280_MODE_MASK) != BMP280_MODE_SLEEP;
+		break;
+	case BMP280_REG_CONFIG:
+		chip->regs[reg] = val;
+		break;
+	default:
+		// Read-only
+		break;
+	}
+}
+
+// Counts for a window of us at the current light level, gain and saturation
+static u16 tsl2561_counts(struct emu_chip *chip, unsigned int per_sec,
+			  u64 us, unsigned int saturation)
+{
+	u8 timing = chip->regs[TSL2561_REG_TIMING];
+	u64 counts;
+
+	counts = div_u64((u64)per_sec * chip->light * wave(chip->conversions),
+			 1000 * 1000);
+	counts = div_u64(counts * us, USEC_PER_SEC);
+	if (timing & TSL2561_GAIN_BIT)
+		counts *= 16;
+
+	return min_t(u64, counts, saturation);
+}
+
+static void tsl2561_latch(struct emu_chip *chip, u64 us,
+			  unsigned int saturation)
+{
+	u16 ch0 = tsl2561_counts(chip, TSL2561_CH0_PER_SEC, us, saturation);
+	u16 ch1 = tsl2561_counts(chip, TSL2561_CH1_PER_SEC, us, saturation);
+
+	chip->regs[TSL2561_REG_DATA_0] = ch0;
+	chip->regs[TSL2561_REG_DATA_0 + 1] = ch0 >> 8;
+	chip->regs[TSL2561_REG_DATA_0 + 2] = ch1;
+	chip->regs[TSL2561_REG_DATA_0 + 3] = ch1 >> 8;
+	chip->conversions++;
+}
+
+static void tsl2561_update(struct emu_chip *chip, ktime_t now)
+{
+	u8 integ = chip->regs[TSL2561_REG_TIMING] & TSL2561_INTEG_MASK;
+	u64 elapsed_us = ktime_us_delta(now, chip->start);
+	u64 n;
+
+	if ((chip->regs[TSL2561_REG_CONTROL] & TSL2561_POWER_MASK) !=
+	    TSL2561_POWER_ON || integ == TSL2561_INTEG_MANUAL)
+		return;
+
+	n = div_u64(elapsed_us, tsl2561_integ_us[integ]);
+	if (n > chip->done) {
+		chip->done = n;
+		tsl2561_latch(chip, tsl2561_integ_us[integ],
+			      tsl2561_saturation[integ]);
+	}
+}
+
+static void tsl2561_reset(struct emu_chip *chip)
+{
+	memset(chip->regs, 0, sizeof(chip->regs));
+	chip->regs[TSL2561_REG_TIMING] = TSL2561_TIMING_RESET;
+	chip->regs[TSL2561_REG_ID] = TSL2561_CHIP_ID;
+	chip->light = 1000;
+}
+
+static u8 tsl2561_read_reg(struct emu_chip *chip, u8 reg)
+{
+	return chip->regs[reg & TSL2561_REG_MASK];
+}
+
+static void tsl2561_write_reg(struct emu_chip *chip, u8 reg, u8 val,
+			      ktime_t now)
+{
+	u8 old;
+
+	reg &= TSL2561_REG_MASK;
+	old = chip->regs[reg];
+
+	switch (reg) {
+	case TSL2561_REG_CONTROL:
+		chip->regs[reg] = val & TSL2561_POWER_MASK;
+		// The ADC restarts and reads as zero until the first cycle
+		if ((val & TSL2561_POWER_MASK) == TSL2561_POWER_ON &&
+		    (old & TSL2561_POWER_MASK) != TSL2561_POWER_ON) {
+			memset(&chip->regs[TSL2561_REG_DATA_0], 0, 4);
+			chip->start = now;
+			chip->done = 0;
+		}
+		break;
+	case TSL2561_REG_TIMING:
+		chip->regs[reg] = val;
+
+		// Manual integration runs while the manual bit is set
+		if ((val & TSL2561_INTEG_MASK) == TSL2561_INTEG_MANUAL) {
+			if ((val & TSL2561_MANUAL_BIT) &&
+			    !(old & TSL2561_MANUAL_BIT)) {
+				chip->start = now;
+			} else if (!(val & TSL2561_MANUAL_BIT) &&
+				   (old & TSL2561_MANUAL_BIT)) {
+				tsl2561_latch(chip,
+					      ktime_us_delta(now, chip->start),
+					      U16_MAX);
+			}
+			break;
+		}
+
+		// Changing the cycle restarts it
+		chip->start = now;
+		chip->done = 0;
+		break;
+	case TSL2561_REG_THRESH ... TSL2561_REG_INTERRUPT:
+		// Thresholds and interrupt control, only stored
+		chip->regs[reg] = val;
+		break;
+	default:
+		break;
+	}
+}
+
+static void emu_chip_reset(struct emu_chip *chip)
+{
+	if (chip->type == EMU_BMP280)
+		bmp280_reset(chip);
+	else
+		tsl2561_reset(chip);
+}
+
+/*
+ * The first byte of a write sets the register pointer, or for the tsl2561 the
+ * command byte. Following bytes are written to consecutive registers.
+ */
+static void emu_chip_write(struct emu_chip *chip, const u8 *buf, u16 len,
+			   ktime_t now)
+{
+	u16 i;
+
+	if (!len)
+		return;
+
+	chip->pointer = buf[0];
+
+	// A tsl2561 command byte with the clear bit only clears the interrupt
+	if (chip->type == EMU_TSL2561 && (buf[0] & TSL2561_CLEAR_BIT))
+		return;
+
+	for (i = 1; i < len; i++, chip->pointer++) {
+		if (chip->type == EMU_BMP280)
+			bmp280_write_reg(chip, chip->pointer, buf[i], now);
+		else
+			tsl2561_write_reg(chip, chip->pointer, buf[i], now);
+	}
+}
+
+static void emu_chip_read(struct emu_chip *chip, u8 *buf, u16 len)
+{
+	u16 i;
+
+	for (i = 0; i < len; i++, chip->pointer++) {
+		if (chip->type == EMU_BMP280)
+			buf[i] = bmp280_read_reg(chip, chip->pointer);
+		else
+			buf[i] = tsl2561_read_reg(chip, chip->pointer);
+	}
+}
+
+static struct emu_chip *emu_find_chip(u16 addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(emu_chips); i++)
+		if (emu_chips[i].addr == addr)
+			return &emu_chips[i];
+
+	return NULL;
+}
+
+// Sleeps for as long as bits take on the bus at bus_khz
+static void emu_bus_delay(unsigned int bits)
+{
+	unsigned int khz = READ_ONCE(bus_khz);
+
+	if (khz)
+		fsleep(DIV_ROUND_UP(bits * 1000, khz));
+}
+
+// Calls are serialized by the adapter's bus lock
+static int emu_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct emu_chip *chip;
+	unsigned int bits = 0;
+	ktime_t now;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		chip = emu_find_chip(msgs[i].addr);
+		if (!chip)
+			return -ENXIO;
+
+		// Address byte, data bytes, and an ack bit for each
+		bits += (1 + msgs[i].len) * 9;
+
+		now = ktime_get();
+		if (chip->type == EMU_BMP280)
+			bmp280_update(chip, now);
+		else
+			tsl2561_update(chip, now);
+
+		if (msgs[i].flags & I2C_M_RD)
+			emu_chip_read(chip, msgs[i].buf, msgs[i].len);
+		else
+			emu_chip_write(chip, msgs[i].buf, msgs[i].len, now);
+
+		chip->msgs++;
+		chip->bytes += msgs[i].len;
+		if (!i)
+			chip->xfers++;
+	}
+
+	emu_bus_delay(bits);
+
+	return num;
+}
+
+static u32 emu_functionality(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm emu_algorithm = {
+	.master_xfer = emu_xfer,
+	.functionality = emu_functionality,
+};
+
+static void emu_debugfs_init(void)
+{
+	struct emu_chip *chip;
+	struct dentry *dir;
+	char name[32];
+	unsigned int i;
+
+	emu_debugfs = debugfs_create_dir("sensor_emu", NULL);
+
+	for (i = 0; i < ARRAY_SIZE(emu_chips); i++) {
+		chip = &emu_chips[i];
+		snprintf(name, sizeof(name), "%s-%02x", chip->name, chip->addr);
+
+		dir = debugfs_create_dir(name, emu_debugfs);
+		debugfs_create_u64("xfers", 0444, dir, &chip->xfers);
+		debugfs_create_u64("msgs", 0444, dir, &chip->msgs);
+		debugfs_create_u64("bytes", 0444, dir, &chip->bytes);
+		debugfs_create_u64("conversions", 0444, dir,
+				   &chip->conversions);
+		if (chip->type == EMU_TSL2561)
+			debugfs_create_u32("light", 0644, dir, &chip->light);
+	}
+}
+
+static int __init sensor_emu_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(emu_chips); i++)
+		emu_chip_reset(&emu_chips[i]);
+
+	emu_adapter.owner = THIS_MODULE;
+	emu_adapter.class = I2C_CLASS_HWMON;
+	emu_adapter.algo = &emu_algorithm;
+	strscpy(emu_adapter.name, "sensor-emu", sizeof(emu_adapter.name));
+
+	ret = i2c_add_adapter(&emu_adapter);
+	if (ret) {
+		pr_err("sensor_emu: failed to add adapter\n");
+		return ret;
+	}
+
+	emu_debugfs_init();
+
+	pr_info("sensor_emu: emulating on i2c-%d\n", emu_adapter.nr);
+
+	return 0;
+}
+
+static void __exit sensor_emu_exit(void)
+{
+	debugfs_remove_recursive(emu_debugfs);
+	i2c_del_adapter(&emu_adapter);
+}
+
+module_init(sensor_emu_init);
+module_exit(sensor_emu_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Michael Harris <michaelharriscode@gmail.com>");
+MODULE_DESCRIPTION("Emulated i2c adapter with bmp280 and tsl2561 register models");
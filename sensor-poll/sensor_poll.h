@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef SENSOR_POLL_H
+#define SENSOR_POLL_H
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+struct kobject;
+struct sensor_poll;
+struct sensor_poll_group;
+
+/**
+ * Callbacks of a polled sensor
+ *
+ * All are called from the poll work with the group lock held, so they must not
+ * call back into sensor_poll functions that take it.
+ *
+ * trigger is optional. It starts a measurement, and is called for every due
+ * sensor of a group before any of them is read, so their conversions overlap.
+ *
+ * read fills in one record, waiting for a triggered measurement if needed.
+ * The u64 timestamp at the start of the record is filled in by the core.
+ *
+ * notify is optional. It is called once per poll after new records were
+ * queued, e.g. to schedule processing of them.
+ */
+struct sensor_poll_ops {
+	int (*trigger)(struct sensor_poll *poll);
+	int (*read)(struct sensor_poll *poll, void *record);
+	void (*notify)(struct sensor_poll *poll);
+};
+
+/**
+ * Counters of a polled sensor
+ *
+ * overruns counts deadlines that passed without a poll because the work ran
+ * late. dropped counts records lost to a full fifo. jitter is how late polls
+ * started after their deadline.
+ */
+struct sensor_poll_stats {
+	u64 samples;
+	u64 errors;
+	u64 overruns;
+	u64 dropped;
+	u64 jitter_max_ns;
+	u64 jitter_total_ns;
+};
+
+/**
+ * A sensor sampled every interval_ms by the polling core
+ *
+ * Sensors with the same key, e.g. their i2c adapter, share one timer and work
+ * item, so their transactions never interleave.
+ *
+ * Records are record_size bytes and start with a u64 CLOCK_MONOTONIC
+ * timestamp in nanoseconds, taken when read returned. They are queued in fifo
+ * by the poll work and taken out with sensor_poll_out.
+ *
+ * Everything is private to the core, except that drivers get at their own
+ * data with container_of.
+ */
+struct sensor_poll {
+	const struct sensor_poll_ops *ops;
+	const void *key;
+	unsigned int record_size;
+	void *record; // buffer for the record being read
+	struct kfifo fifo;
+	struct mutex out_lock; // serializes sensor_poll_out callers
+	atomic_t interval_ms;
+	struct sensor_poll_group *group;
+	struct list_head node; // in group->polls
+	ktime_t next_poll;
+	atomic_t reschedule; // set by sensor_poll_set_interval, taken by the work
+	bool due;
+	bool paused; // written under the group lock once started
+	spinlock_t stats_lock; // protects stats
+	struct sensor_poll_stats stats;
+	struct kobject *stats_kobj;
+};
+
+int sensor_poll_init(struct sensor_poll *poll,
+		     const struct sensor_poll_ops *ops, const void *key,
+		     unsigned int record_size, unsigned int fifo_records,
+		     unsigned int interval_ms);
+void sensor_poll_free(struct sensor_poll *poll);
+
+int sensor_poll_start(struct sensor_poll *poll, struct kobject *parent);
+void sensor_poll_stop(struct sensor_poll *poll);
+
+void sensor_poll_pause(struct sensor_poll *poll);
+void sensor_poll_resume(struct sensor_poll *poll);
+void sensor_poll_set_interval(struct sensor_poll *poll,
+			      unsigned int interval_ms);
+void sensor_poll_flush(struct sensor_poll *poll);
+
+unsigned int sensor_poll_out(struct sensor_poll *poll, void *records,
+			     unsigned int count);
+unsigned int sensor_poll_len(struct sensor_poll *poll);
+void sensor_poll_get_stats(struct sensor_poll *poll,
+			   struct sensor_poll_stats *stats);
+
+// Used by sensor_poll_start and sensor_poll_stop, not exported
+int sensor_poll_sysfs_add(struct sensor_poll *poll, struct kobject *parent);
+void sensor_poll_sysfs_remove(struct sensor_poll *poll);
+
+static inline unsigned int sensor_poll_interval(struct sensor_poll *poll)
+{
+	return atomic_read(&poll->interval_ms);
+}
+
+#endif /* SENSOR_POLL_H */
@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Deadline scheduled polling of sensors
+ *
+ * Sensors are put into groups by key. Each group has one hrtimer, armed for
+ * the earliest deadline of its sensors, and one work item on a dedicated
+ * workqueue that polls every sensor whose deadline has passed.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include "sensor_poll.h"
+
+#define CREATE_TRACE_POINTS
+#include "sensor_poll_trace.h"
+
+// Offset between the first polls of sensors sharing a group
+#define GROUP_STAGGER_MS	5
+
+/**
+ * Polling state shared by every sensor with the same key
+ *
+ * The timer is armed for the earliest next_poll of the sensors.
+ */
+struct sensor_poll_group {
+	struct list_head node; // in sensor_poll_groups
+	const void *key;
+	struct list_head polls;
+	struct mutex lock; // protects polls and their scheduling state
+	struct hrtimer timer;
+	struct work_struct work;
+	unsigned int slots; // used to stagger sensors as they join
+};
+
+static struct workqueue_struct *sensor_poll_wq;
+
+// All groups with at least one sensor in them
+static LIST_HEAD(sensor_poll_groups);
+static DEFINE_MUTEX(sensor_poll_groups_lock); // protects sensor_poll_groups
+
+/**
+ * Prepares a sensor for polling
+ *
+ * The fifo holds at least fifo_records records of record_size bytes, which
+ * includes the leading u64 timestamp.
+ */
+int sensor_poll_init(struct sensor_poll *poll,
+		     const struct sensor_poll_ops *ops, const void *key,
+		     unsigned int record_size, unsigned int fifo_records,
+		     unsigned int interval_ms)
+{
+	int ret;
+
+	if (!ops || !ops->read || record_size < sizeof(u64) || !interval_ms)
+		return -EINVAL;
+
+	memset(poll, 0, sizeof(*poll));
+	poll->ops = ops;
+	poll->key = key;
+	poll->record_size = record_size;
+	atomic_set(&poll->interval_ms, interval_ms);
+	mutex_init(&poll->out_lock);
+	spin_lock_init(&poll->stats_lock);
+	INIT_LIST_HEAD(&poll->node);
+
+	poll->record = kzalloc(record_size, GFP_KERNEL);
+	if (!poll->record)
+		return -ENOMEM;
+
+	ret = kfifo_alloc(&poll->fifo,
+			  roundup_pow_of_two(record_size * fifo_records),
+			  GFP_KERNEL);
+	if (ret) {
+		kfree(poll->record);
+		return ret;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sensor_poll_init);
+
+// Frees what sensor_poll_init allocated. The sensor must be stopped
+void sensor_poll_free(struct sensor_poll *poll)
+{
+	kfifo_free(&poll->fifo);
+	kfree(poll->record);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_free);
+
+static void sensor_poll_count_error(struct sensor_poll *poll)
+{
+	spin_lock(&poll->stats_lock);
+	poll->stats.errors++;
+	spin_unlock(&poll->stats_lock);
+}
+
+/*
+ * Moves next_poll past now. The first deadline passed is the one just served
+ * or failed, every further one is skipped rather than run late and counted
+ * as an overrun.
+ */
+static void sensor_poll_advance(struct sensor_poll *poll, ktime_t now)
+{
+	u64 missed = 0;
+
+	while (ktime_compare(poll->next_poll, now) <= 0) {
+		poll->next_poll = ktime_add_ms(poll->next_poll,
+					       atomic_read(&poll->interval_ms));
+		missed++;
+	}
+
+	if (missed > 1) {
+		spin_lock(&poll->stats_lock);
+		poll->stats.overruns += missed - 1;
+		spin_unlock(&poll->stats_lock);
+	}
+}
+
+// Reads one record into the fifo, dropping it if the fifo is full
+static void sensor_poll_read(struct sensor_poll *poll)
+{
+	bool queued = false;
+	int ret;
+
+	ret = poll->ops->read(poll, poll->record);
+	if (ret) {
+		sensor_poll_count_error(poll);
+		return;
+	}
+
+	*(u64 *)poll->record = ktime_get_ns();
+
+	if (kfifo_avail(&poll->fifo) >= poll->record_size) {
+		kfifo_in(&poll->fifo, poll->record, poll->record_size);
+		queued = true;
+	}
+
+	spin_lock(&poll->stats_lock);
+	if (queued)
+		poll->stats.samples++;
+	else
+		poll->stats.dropped++;
+	spin_unlock(&poll->stats_lock);
+
+	if (queued && poll->ops->notify)
+		poll->ops->notify(poll);
+}
+
+/*
+ * Polls every sensor of the group whose next_poll has passed, and rearms the
+ * group timer for the earliest next_poll.
+ *
+ * Every due sensor is triggered before any is read, so conversions overlap
+ * instead of running back to back.
+ *
+ * Only the sensors polled in this pass move on to their next deadline. One
+ * whose deadline passed while the others were read keeps it, so the timer
+ * fires straight away and it is polled late instead of skipped.
+ */
+static void sensor_poll_work(struct work_struct *work)
+{
+	struct sensor_poll_group *group = container_of(work,
+						       struct sensor_poll_group,
+						       work);
+	struct sensor_poll *poll;
+	ktime_t now, next = KTIME_MAX;
+	unsigned int polled = 0;
+	u64 late_ns;
+
+	mutex_lock(&group->lock);
+
+	now = ktime_get();
+
+	list_for_each_entry(poll, &group->polls, node) {
+		// A new interval polls straight away
+		if (atomic_xchg(&poll->reschedule, 0))
+			poll->next_poll = now;
+
+		poll->due = !poll->paused &&
+			    ktime_compare(poll->next_poll, now) <= 0;
+		if (!poll->due)
+			continue;
+
+		late_ns = ktime_to_ns(ktime_sub(now, poll->next_poll));
+
+		spin_lock(&poll->stats_lock);
+		poll->stats.jitter_total_ns += late_ns;
+		poll->stats.jitter_max_ns = max(poll->stats.jitter_max_ns,
+						late_ns);
+		spin_unlock(&poll->stats_lock);
+
+		// A failed sensor waits for its next deadline to try again
+		if (poll->ops->trigger && poll->ops->trigger(poll)) {
+			sensor_poll_count_error(poll);
+			sensor_poll_advance(poll, now);
+			poll->due = false;
+		}
+	}
+
+	list_for_each_entry(poll, &group->polls, node) {
+		if (poll->due) {
+			sensor_poll_read(poll);
+			sensor_poll_advance(poll, ktime_get());
+			polled++;
+		}
+
+		// Paused sensors aren't polled, so they don't arm the timer
+		if (poll->paused)
+			continue;
+
+		if (ktime_before(poll->next_poll, next))
+			next = poll->next_poll;
+	}
+
+	if (next != KTIME_MAX)
+		hrtimer_start(&group->timer, next, HRTIMER_MODE_ABS);
+
+	trace_sensor_poll_work(polled, next == KTIME_MAX ? -1 :
+			       ktime_us_delta(next, ktime_get()));
+
+	mutex_unlock(&group->lock);
+}
+
+static enum hrtimer_restart sensor_poll_timer_callback(struct hrtimer *timer)
+{
+	struct sensor_poll_group *group = container_of(timer,
+						       struct sensor_poll_group,
+						       timer);
+
+	queue_work(sensor_poll_wq, &group->work);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Adds the sensor to the group of its key, creating the group if this is its
+ * first sensor. Its first poll is staggered from the other sensors.
+ *
+ * With a parent, the counters are shown in a poll_stats directory under it.
+ */
+int sensor_poll_start(struct sensor_poll *poll, struct kobject *parent)
+{
+	struct sensor_poll_group *group;
+	unsigned int interval, offset;
+	int ret;
+
+	if (parent) {
+		ret = sensor_poll_sysfs_add(poll, parent);
+		if (ret)
+			return ret;
+	}
+
+	mutex_lock(&sensor_poll_groups_lock);
+
+	list_for_each_entry(group, &sensor_poll_groups, node)
+		if (group->key == poll->key)
+			goto found;
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group) {
+		mutex_unlock(&sensor_poll_groups_lock);
+		sensor_poll_sysfs_remove(poll);
+		return -ENOMEM;
+	}
+
+	group->key = poll->key;
+	INIT_LIST_HEAD(&group->polls);
+	mutex_init(&group->lock);
+	INIT_WORK(&group->work, sensor_poll_work);
+	hrtimer_setup(&group->timer, sensor_poll_timer_callback,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	list_add(&group->node, &sensor_poll_groups);
+
+found:
+	mutex_lock(&group->lock);
+
+	interval = atomic_read(&poll->interval_ms);
+	offset = (group->slots++ * GROUP_STAGGER_MS) % interval;
+	poll->group = group;
+	poll->next_poll = ktime_add_ms(ktime_get(), interval + offset);
+	list_add_tail(&poll->node, &group->polls);
+
+	mutex_unlock(&group->lock);
+	mutex_unlock(&sensor_poll_groups_lock);
+
+	// Rearms the timer to include the new sensor
+	queue_work(sensor_poll_wq, &group->work);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sensor_poll_start);
+
+// Removes the sensor from its group, freeing the group if it was the last one
+void sensor_poll_stop(struct sensor_poll *poll)
+{
+	struct sensor_poll_group *group = poll->group;
+	bool empty;
+
+	sensor_poll_sysfs_remove(poll);
+
+	if (!group)
+		return;
+
+	mutex_lock(&sensor_poll_groups_lock);
+
+	mutex_lock(&group->lock);
+	list_del_init(&poll->node);
+	poll->group = NULL;
+	empty = list_empty(&group->polls);
+	mutex_unlock(&group->lock);
+
+	if (empty) {
+		list_del(&group->node);
+
+		// With no sensors left the work no longer rearms the timer, so
+		// once both are stopped neither can run again
+		hrtimer_cancel(&group->timer);
+		cancel_work_sync(&group->work);
+
+		kfree(group);
+	}
+
+	mutex_unlock(&sensor_poll_groups_lock);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_stop);
+
+/*
+ * Stops polling the sensor until sensor_poll_resume. Once this returns, no
+ * poll of it is running. Can be called before sensor_poll_start
+ */
+void sensor_poll_pause(struct sensor_poll *poll)
+{
+	struct sensor_poll_group *group = poll->group;
+
+	if (!group) {
+		poll->paused = true;
+		return;
+	}
+
+	mutex_lock(&group->lock);
+	poll->paused = true;
+	mutex_unlock(&group->lock);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_pause);
+
+// Polls straight away, and then every interval again
+void sensor_poll_resume(struct sensor_poll *poll)
+{
+	struct sensor_poll_group *group = poll->group;
+
+	if (!group) {
+		poll->paused = false;
+		return;
+	}
+
+	mutex_lock(&group->lock);
+	poll->paused = false;
+	poll->next_poll = ktime_get();
+	mutex_unlock(&group->lock);
+
+	queue_work(sensor_poll_wq, &group->work);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_resume);
+
+/*
+ * Polls once now, and then with the new interval
+ *
+ * Doesn't take the group lock, so it returns straight away even while a poll
+ * of the group is waiting on a measurement. The work picks up the change on
+ * its next run.
+ */
+void sensor_poll_set_interval(struct sensor_poll *poll,
+			      unsigned int interval_ms)
+{
+	struct sensor_poll_group *group = READ_ONCE(poll->group);
+
+	atomic_set(&poll->interval_ms, max(interval_ms, 1U));
+
+	if (!group)
+		return;
+
+	atomic_set(&poll->reschedule, 1);
+	queue_work(sensor_poll_wq, &group->work);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_set_interval);
+
+// Waits for a queued or running poll of the sensor's group to finish
+void sensor_poll_flush(struct sensor_poll *poll)
+{
+	if (poll->group)
+		flush_work(&poll->group->work);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_flush);
+
+/*
+ * Takes up to count records out of the fifo, oldest first.
+ *
+ * Returns the number of records copied into records
+ */
+unsigned int sensor_poll_out(struct sensor_poll *poll, void *records,
+			     unsigned int count)
+{
+	unsigned int n;
+
+	mutex_lock(&poll->out_lock);
+
+	n = min(count, kfifo_len(&poll->fifo) / poll->record_size);
+	n = kfifo_out(&poll->fifo, records, n * poll->record_size) /
+	    poll->record_size;
+
+	mutex_unlock(&poll->out_lock);
+
+	return n;
+}
+EXPORT_SYMBOL_GPL(sensor_poll_out);
+
+// Number of records waiting in the fifo
+unsigned int sensor_poll_len(struct sensor_poll *poll)
+{
+	return kfifo_len(&poll->fifo) / poll->record_size;
+}
+EXPORT_SYMBOL_GPL(sensor_poll_len);
+
+void sensor_poll_get_stats(struct sensor_poll *poll,
+			   struct sensor_poll_stats *stats)
+{
+	spin_lock(&poll->stats_lock);
+	*stats = poll->stats;
+	spin_unlock(&poll->stats_lock);
+}
+EXPORT_SYMBOL_GPL(sensor_poll_get_stats);
+
+static int __init sensor_poll_module_init(void)
+{
+	// Polls are short and latency sensitive
+	sensor_poll_wq = alloc_workqueue("sensor_poll", WQ_HIGHPRI, 0);
+	if (!sensor_poll_wq)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void __exit sensor_poll_module_exit(void)
+{
+	destroy_workqueue(sensor_poll_wq);
+}
+
+module_init(sensor_poll_module_init);
+module_exit(sensor_poll_module_exit);
+
+MODULE_AUTHOR("Michael Harris <michaelharriscode@gmail.com>");
+MODULE_DESCRIPTION("Shared polling core for sensor drivers");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * poll_stats directory with the counters of a polled sensor
+ *
+ * The directory is its own kobject, so the attributes find the sensor without
+ * knowing anything about the driver that owns its parent.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/math64.h>
+#include "sensor_poll.h"
+
+struct sensor_poll_kobj {
+	struct kobject kobj;
+	struct sensor_poll *poll;
+};
+
+static struct sensor_poll *kobj_to_poll(struct kobject *kobj)
+{
+	return container_of(kobj, struct sensor_poll_kobj, kobj)->poll;
+}
+
+static ssize_t samples_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	struct sensor_poll_stats stats;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	return sysfs_emit(buf, "%llu\n", stats.samples);
+}
+
+static ssize_t errors_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	struct sensor_poll_stats stats;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	return sysfs_emit(buf, "%llu\n", stats.errors);
+}
+
+static ssize_t overruns_show(struct kobject *kobj, struct kobj_attribute *attr,
+			     char *buf)
+{
+	struct sensor_poll_stats stats;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	return sysfs_emit(buf, "%llu\n", stats.overruns);
+}
+
+static ssize_t dropped_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	struct sensor_poll_stats stats;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	return sysfs_emit(buf, "%llu\n", stats.dropped);
+}
+
+// Worst lateness of a poll behind its deadline, in microseconds
+static ssize_t jitter_max_us_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	struct sensor_poll_stats stats;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	return sysfs_emit(buf, "%llu\n", div_u64(stats.jitter_max_ns,
+						 NSEC_PER_USEC));
+}
+
+// Mean lateness of the polls, in microseconds
+static ssize_t jitter_avg_us_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	struct sensor_poll_stats stats;
+	u64 polls;
+
+	sensor_poll_get_stats(kobj_to_poll(kobj), &stats);
+
+	polls = stats.samples + stats.dropped + stats.errors;
+	if (!polls)
+		return sysfs_emit(buf, "0\n");
+
+	return sysfs_emit(buf, "%llu\n",
+			  div64_u64(stats.jitter_total_ns,
+				    polls * NSEC_PER_USEC));
+}
+
+// Records waiting to be taken out by the driver
+static ssize_t queued_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return sysfs_emit(buf, "%u\n", sensor_poll_len(kobj_to_poll(kobj)));
+}
+
+static struct kobj_attribute samples_attr = __ATTR_RO(samples);
+static struct kobj_attribute errors_attr = __ATTR_RO(errors);
+static struct kobj_attribute overruns_attr = __ATTR_RO(overruns);
+static struct kobj_attribute dropped_attr = __ATTR_RO(dropped);
+static struct kobj_attribute jitter_max_us_attr = __ATTR_RO(jitter_max_us);
+static struct kobj_attribute jitter_avg_us_attr = __ATTR_RO(jitter_avg_us);
+static struct kobj_attribute queued_attr = __ATTR_RO(queued);
+
+static struct attribute *sensor_poll_stats_attrs[] = {
+	&samples_attr.attr,
+	&errors_attr.attr,
+	&overruns_attr.attr,
+	&dropped_attr.attr,
+	&jitter_max_us_attr.attr,
+	&jitter_avg_us_attr.attr,
+	&queued_attr.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(sensor_poll_stats);
+
+static void sensor_poll_kobj_release(struct kobject *kobj)
+{
+	kfree(container_of(kobj, struct sensor_poll_kobj, kobj));
+}
+
+static const struct kobj_type sensor_poll_ktype = {
+	.release = sensor_poll_kobj_release,
+	.sysfs_ops = &kobj_sysfs_ops,
+	.default_groups = sensor_poll_stats_groups,
+};
+
+int sensor_poll_sysfs_add(struct sensor_poll *poll, struct kobject *parent)
+{
+	struct sensor_poll_kobj *stats;
+	int ret;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	stats->poll = poll;
+
+	ret = kobject_init_and_add(&stats->kobj, &sensor_poll_ktype, parent,
+				   "poll_stats");
+	if (ret) {
+		kobject_put(&stats->kobj);
+		return ret;
+	}
+
+	poll->stats_kobj = &stats->kobj;
+
+	return 0;
+}
+
+/*
+ * Removing the kobject waits for running show calls, so the sensor is never
+ * used once this returns
+ */
+void sensor_poll_sysfs_remove(struct sensor_poll *poll)
+{
+	if (!poll->stats_kobj)
+		return;
+
+	kobject_del(poll->stats_kobj);
+	kobject_put(poll->stats_kobj);
+	poll->stats_kobj = NULL;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the sensor polling core
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sensor_poll
+
+#if !defined(SENSOR_POLL_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define SENSOR_POLL_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One run of a group's poll work. next_us is how far away the next run is, or
+ * -1 if the timer wasn't rearmed
+ */
+TRACE_EVENT(sensor_poll_work,
+	TP_PROTO(unsigned int polled, s64 next_us),
+	TP_ARGS(polled, next_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, polled)
+		__field(s64, next_us)
+	),
+
+	TP_fast_assign(
+		__entry->polled = polled;
+		__entry->next_us = next_us;
+	),
+
+	TP_printk("polled=%u next_us=%lld", __entry->polled, __entry->next_us)
+);
+
+#endif /* SENSOR_POLL_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sensor_poll_trace
+#include <trace/define_trace.h>
@@ -7,13 +7,20 @@
 #include <linux/workqueue.h>
 #include "timed_logger.h"
 
+#define CREATE_TRACE_POINTS
+#include "timed_logger_trace.h"
+
 static struct hrtimer timer;
 
 static enum hrtimer_restart timer_callback(struct hrtimer *timer)
 {
+	u64 overruns;
+
 	schedule_work(&timer_queue);
 
-	hrtimer_forward_now(timer, ktime_set(interval_sec, 0));
+	overruns = hrtimer_forward_now(timer, ktime_set(interval_sec, 0));
+	trace_timed_logger_timer_expire(interval_sec, overruns);
+
 	return HRTIMER_RESTART;
 }
 
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the timed logger timer and work
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM timed_logger
+
+#if !defined(TIMED_LOGGER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define TIMED_LOGGER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// overruns is the number of intervals the timer was forwarded by, so >1 means
+// expiries were missed
+TRACE_EVENT(timed_logger_timer_expire,
+	TP_PROTO(int interval_sec, u64 overruns),
+	TP_ARGS(interval_sec, overruns),
+
+	TP_STRUCT__entry(
+		__field(int, interval_sec)
+		__field(u64, overruns)
+	),
+
+	TP_fast_assign(
+		__entry->interval_sec = interval_sec;
+		__entry->overruns = overruns;
+	),
+
+	TP_printk("interval_sec=%d overruns=%llu",
+		  __entry->interval_sec, __entry->overruns)
+);
+
+// Uptime printed by the work, in seconds
+TRACE_EVENT(timed_logger_print,
+	TP_PROTO(s64 uptime_sec),
+	TP_ARGS(uptime_sec),
+
+	TP_STRUCT__entry(
+		__field(s64, uptime_sec)
+	),
+
+	TP_fast_assign(
+		__entry->uptime_sec = uptime_sec;
+	),
+
+	TP_printk("uptime_sec=%lld", __entry->uptime_sec)
+);
+
+#endif /* TIMED_LOGGER_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE timed_logger_trace
+#include <trace/define_trace.h>
@@ -4,6 +4,7 @@
 #include <linux/ktime.h>
 #include <linux/workqueue.h>
 #include "timed_logger.h"
+#include "timed_logger_trace.h"
 
 #define SEC_PER_MIN 60
 #define SEC_PER_HR 3600
@@ -18,6 +19,8 @@ static void print_time(struct work_struct *workqueue)
 	s64 time_hr = (time_raw_seconds / SEC_PER_HR) % 24;
 	s64 time_day = time_raw_seconds / SEC_PER_DAY;
 
+	trace_timed_logger_print(time_raw_seconds);
+
 	pr_info("timed_logger: %lldd %02lldh %02lldm %02llds",
 		time_day, time_hr, time_min, time_s);
 }
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef TSL2561_H
+#define TSL2561_H
+
+#include <linux/types.h>
+
+/**
+ * For the package type of the TSL2561
+ *
+ * Determines which lux coefficients to use. Taken from the i2c device id
+ */
+enum tsl2561_package_type {
+	PACKAGE_CS,
+	PACKAGE_T_FN_CL
+};
+
+// Actual length of the fixed integration times, in microseconds
+#define TSL2561_INTEG_13MS_US	13700
+#define TSL2561_INTEG_101MS_US	101000
+#define TSL2561_INTEG_402MS_US	402000
+
+// Fractional bits of the lux returned by tsl2561_lux
+#define TSL2561_LUX_SCALE	14
+
+u32 tsl2561_ch_scale(u32 integ_us, bool gain_16x);
+u64 tsl2561_lux(enum tsl2561_package_type package, u16 ch0, u16 ch1,
+		u32 ch_scale);
+
+#endif /* TSL2561_H */
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Lux calculation for the tsl2561
+ *
+ * This is the integer version of the lux formula from the "Calculating Lux"
+ * section of the datasheet. It holds no state and only depends on the raw
+ * counts passed in, so it can be built and checked outside of the driver.
+ *
+ * Counts are first normalized to 402ms at 16x gain. The lux then comes from
+ * a piecewise linear function of the CH1/CH0 ratio, with coefficients that
+ * depend on the package.
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/math64.h>
+#include "tsl2561.h"
+
+#define RATIO_SCALE	9  // fractional bits of the CH1/CH0 ratio
+#define CH_SCALE	10 // fractional bits of the channel scale
+
+// 322/11 and 322/81 scaled by 2^CH_SCALE, for the 13.7ms and 101ms times
+#define CHSCALE_TINT0	0x7517
+#define CHSCALE_TINT1	0x0FE7
+
+/**
+ * One piece of the piecewise lux formula
+ *
+ * Used while the CH1/CH0 ratio is at most k. Then
+ * lux = ch0 * b - ch1 * m, all scaled by 2^TSL2561_LUX_SCALE
+ */
+struct tsl2561_lux_coeff {
+	u16 k; // ratio scaled by 2^RATIO_SCALE
+	u16 b;
+	u16 m;
+};
+
+static const struct tsl2561_lux_coeff lux_coeff_t_fn_cl[] = {
+	{ 0x0040, 0x01F2, 0x01BE },
+	{ 0x0080, 0x0214, 0x02D1 },
+	{ 0x00C0, 0x023F, 0x037B },
+	{ 0x0100, 0x0270, 0x03FE },
+	{ 0x0138, 0x016F, 0x01FC },
+	{ 0x019A, 0x00D2, 0x00FB },
+	{ 0x029A, 0x0018, 0x0012 },
+	{ 0xFFFF, 0x0000, 0x0000 }
+};
+
+static const struct tsl2561_lux_coeff lux_coeff_cs[] = {
+	{ 0x0043, 0x0204, 0x01AD },
+	{ 0x0085, 0x0228, 0x02C1 },
+	{ 0x00C8, 0x0253, 0x0363 },
+	{ 0x010A, 0x0282, 0x03DF },
+	{ 0x014D, 0x0177, 0x01DD },
+	{ 0x019A, 0x0101, 0x0127 },
+	{ 0x029A, 0x0037, 0x002B },
+	{ 0xFFFF, 0x0000, 0x0000 }
+};
+
+/**
+ * Scale that normalizes counts to 402ms at 16x gain
+ *
+ * The fixed times use the datasheet constants. Any other time is scaled
+ * from the 402ms one.
+ *
+ * Returns the scale with CH_SCALE fractional bits
+ */
+u32 tsl2561_ch_scale(u32 integ_us, bool gain_16x)
+{
+	u32 scale;
+
+	switch (integ_us) {
+	case TSL2561_INTEG_13MS_US:
+		scale = CHSCALE_TINT0;
+		break;
+	case TSL2561_INTEG_101MS_US:
+		scale = CHSCALE_TINT1;
+		break;
+	case TSL2561_INTEG_402MS_US:
+		scale = 1 << CH_SCALE;
+		break;
+	default:
+		scale = div_u64((u64)TSL2561_INTEG_402MS_US << CH_SCALE,
+				integ_us);
+	}
+
+	if (!gain_16x)
+		scale <<= 4;
+
+	return scale;
+}
+
+/**
+ * Lux from the raw counts of both channels
+ *
+ * ch_scale comes from tsl2561_ch_scale for the gain and integration time the
+ * counts were taken with. Counts from a saturated channel give a meaningless
+ * result, so callers should reject those first.
+ *
+ * Returns lux with TSL2561_LUX_SCALE fractional bits
+ */
+u64 tsl2561_lux(enum tsl2561_package_type package, u16 ch0, u16 ch1,
+		u32 ch_scale)
+{
+	const struct tsl2561_lux_coeff *coeff, *last;
+	u64 channel0, channel1;
+	u64 ratio = 0;
+	u64 b, m;
+
+	channel0 = ((u64)ch0 * ch_scale) >> CH_SCALE;
+	channel1 = ((u64)ch1 * ch_scale) >> CH_SCALE;
+
+	// Rounded to RATIO_SCALE bits by computing one extra bit first
+	if (channel0)
+		ratio = div64_u64(channel1 << (RATIO_SCALE + 1), channel0);
+	ratio = (ratio + 1) >> 1;
+
+	if (package == PACKAGE_CS) {
+		coeff = lux_coeff_cs;
+		last = &lux_coeff_cs[ARRAY_SIZE(lux_coeff_cs) - 1];
+	} else {
+		coeff = lux_coeff_t_fn_cl;
+		last = &lux_coeff_t_fn_cl[ARRAY_SIZE(lux_coeff_t_fn_cl) - 1];
+	}
+
+	/*
+	 * The ratio goes far past the last k when CH1 dwarfs CH0. The last
+	 * piece covers all of that, like the datasheet's final else.
+	 */
+	while (coeff < last && ratio > coeff->k)
+		coeff++;
+
+	b = channel0 * coeff->b;
+	m = channel1 * coeff->m;
+
+	return b > m ? b - m : 0;
+}
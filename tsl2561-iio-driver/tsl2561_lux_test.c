@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests for the tsl2561 lux calculation
+ *
+ * The calculation is built into this module directly, so the tests don't
+ * need the driver or a sensor. Run with:
+ *
+ *	sudo insmod tsl2561_lux_test.ko
+ *	sudo cat /sys/kernel/debug/kunit/tsl2561_lux/results
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include "tsl2561_lux.c"
+
+#define BENCH_CALLS (1 << 22)
+
+static void tsl2561_ch_scale_test(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, tsl2561_ch_scale(TSL2561_INTEG_402MS_US, true),
+			1 << CH_SCALE);
+	KUNIT_EXPECT_EQ(test, tsl2561_ch_scale(TSL2561_INTEG_101MS_US, true),
+			CHSCALE_TINT1);
+	KUNIT_EXPECT_EQ(test, tsl2561_ch_scale(TSL2561_INTEG_13MS_US, false),
+			CHSCALE_TINT0 << 4);
+
+	// Manual windows scale from the 402ms time
+	KUNIT_EXPECT_EQ(test, tsl2561_ch_scale(201000, true), 2 << CH_SCALE);
+}
+
+// Each value picks a different piece of the formula
+static void tsl2561_lux_pieces_test(struct kunit *test)
+{
+	u32 scale = tsl2561_ch_scale(TSL2561_INTEG_402MS_US, true);
+
+	// No IR, first piece: 1000 * 0x01F2
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 1000, 0, scale),
+			498000);
+	// Ratio of exactly 0.5: 1000 * 0x0270 - 500 * 0x03FE
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 1000, 500, scale),
+			113000);
+	// Same counts, CS coefficients: 1000 * 0x0282 - 500 * 0x03DF
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_CS, 1000, 500, scale),
+			146500);
+	// 13.7ms at 1x, third piece
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 100, 30,
+					  tsl2561_ch_scale(TSL2561_INTEG_13MS_US,
+							   false)),
+			14411575);
+}
+
+/*
+ * Ratios past the last k have to use the last piece, which gives 0 lux,
+ * instead of walking off the end of the table
+ */
+static void tsl2561_lux_large_ratio_test(struct kunit *test)
+{
+	u32 scale = tsl2561_ch_scale(TSL2561_INTEG_402MS_US, true);
+
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 100, 300, scale), 0);
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 1, 200, scale), 0);
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_CS, 1, 200, scale), 0);
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 1, 0xFFFF,
+					  tsl2561_ch_scale(TSL2561_INTEG_13MS_US,
+							   false)),
+			0);
+}
+
+// Darkness on CH0 gives a ratio of 0 rather than a division by zero
+static void tsl2561_lux_zero_ch0_test(struct kunit *test)
+{
+	u32 scale = tsl2561_ch_scale(TSL2561_INTEG_402MS_US, true);
+
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 0, 0, scale), 0);
+	KUNIT_EXPECT_EQ(test, tsl2561_lux(PACKAGE_T_FN_CL, 0, 5, scale), 0);
+}
+
+/*
+ * Not a correctness test, reports the cost of one lux calculation over
+ * counts spread across all pieces of the formula
+ */
+static void tsl2561_lux_bench(struct kunit *test)
+{
+	u32 scale = tsl2561_ch_scale(TSL2561_INTEG_101MS_US, true);
+	u64 start, ns, sum = 0;
+	unsigned int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_CALLS; i++)
+		sum += tsl2561_lux(PACKAGE_T_FN_CL, 1000 + (i & 0xFFF),
+				   i & 0x7FF, scale);
+	ns = ktime_get_ns() - start;
+
+	// Printing the sum keeps the loop from being optimized out
+	kunit_info(test, "%u calls: %llu ns/call (sum %llu)\n", BENCH_CALLS,
+		   div_u64(ns, BENCH_CALLS), sum);
+}
+
+static struct kunit_case tsl2561_lux_cases[] = {
+	KUNIT_CASE(tsl2561_ch_scale_test),
+	KUNIT_CASE(tsl2561_lux_pieces_test),
+	KUNIT_CASE(tsl2561_lux_large_ratio_test),
+	KUNIT_CASE(tsl2561_lux_zero_ch0_test),
+	KUNIT_CASE_SLOW(tsl2561_lux_bench),
+	{}
+};
+
+static struct kunit_suite tsl2561_lux_suite = {
+	.name = "tsl2561_lux",
+	.test_cases = tsl2561_lux_cases,
+};
+
+kunit_test_suite(tsl2561_lux_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("KUnit tests for the tsl2561 lux calculation");
@@ -0,0 +1,1702 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/regmap.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/events.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#include <linux/interrupt.h>
+#include <linux/sysfs.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/math64.h>
+#include <linux/pm_runtime.h>
+#include "tsl2561.h"
+#include "sensor_poll.h"
+
+#define CREATE_TRACE_POINTS
+#include "tsl2561_trace.h"
+
+#define REG_CONTROL		0x00
+#define REG_TIMING		0x01
+#define REG_THRESH_LOW_LOW	0x02
+#define REG_THRESH_LOW_HIGH	0x03
+#define REG_THRESH_HIGH_LOW	0x04
+#define REG_THRESH_HIGH_HIGH	0x05
+#define REG_INTERRUPT		0x06
+#define REG_CRC			0x07
+#define REG_ID			0x0A
+#define REG_DATA_0_LOW		0x0C
+#define REG_DATA_0_HIGH		0x0D
+#define REG_DATA_1_LOW		0x0E
+#define REG_DATA_1_HIGH		0x0F
+
+#define CMD_BIT			0x80
+#define CLEAR_BIT		0x40
+#define WORD_BIT		0x20
+#define BLOCK_BIT		0x10
+
+#define INTEG_TIME_MASK		0x03 // 0b00000011
+#define GAIN_SHIFT		4
+#define GAIN_MASK		0x10 // 0b00010000
+#define MANUAL_SHIFT		3
+#define MANUAL_MASK		0x08 // 0b00001000
+#define INTR_SHIFT		4
+#define INTR_MASK		0x30 // 0b00110000
+#define PERSIST_MASK		0x0F // 0b00001111
+
+// Time without reads before the sensor is powered off
+#define AUTOSUSPEND_MS		2000
+
+// Auto-ranging aims for at least this many counts on the brighter channel
+#define AUTO_RANGE_MIN_COUNTS	1000
+// Re-reads allowed for a sysfs read to settle on a new range
+#define AUTO_RANGE_TRIES	3
+// Index of 13ms at 1x in tsl2561_ranges
+#define RANGE_LEAST_SENSITIVE	1
+
+// Limits of manual integration windows
+#define MANUAL_MIN_US		50
+#define MANUAL_MAX_US		5000000
+// Allowed lateness of the end of a manual window
+#define MANUAL_SLACK_NS		20000
+
+// Limits of the polling interval in software buffer mode. Polling faster than
+// the shortest integration time would only return the same reading again
+#define POLL_INTERVAL_MIN_MS	14
+#define POLL_INTERVAL_MAX_MS	10000
+// Readings queued between polls and pushing them to the buffer
+#define POLL_FIFO_SIZE		64
+
+// For the POWER bits of the control register
+enum tsl2561_power {
+	POWER_ON = 0x03,
+	POWER_OFF = 0x00
+};
+
+/*
+ * For the GAIN bit of the timing register
+ *
+ * Used for switching between low/high gain modes
+ */
+enum tsl2561_gain {
+	GAIN_1x = 0x00,
+	GAIN_16x = 0x01
+};
+
+/*
+ * For the MANUAL bit of the timing register
+ *
+ * Used for manually beginning/stopping integration cycles.
+ * The INTEG register must be set to INTEG_TIME_MANUAL (0x03) to use this.
+ */
+enum tsl2561_manual {
+	MANUAL_STOP = 0x00,
+	MANUAL_START = 0x01
+};
+
+/*
+ * For the INTEG bits of the timing register
+ *
+ * Used to choose nominal integration time for each conversion.
+ * INTEG_TIME_MANUAL makes it manual with the usage of the MANUAL bit
+ */
+enum tsl2561_integ_time {
+	INTEG_TIME_13MS = 0x00, // Actual 13.7ms
+	INTEG_TIME_101MS = 0x01,
+	INTEG_TIME_402MS = 0x02,
+	INTEG_TIME_MANUAL = 0x03
+};
+
+/*
+ * For the INTR bit of the interrupt control register
+ *
+ * Used to choose the mode for the interrupt logic. Level interrupts hold the
+ * INT pin low until cleared by a command with CLEAR_BIT set.
+ */
+enum tsl2561_intr {
+	INTR_DISABLED = 0x00,
+	INTR_LEVEL_INTERRUPT = 0x01,
+	INTR_SMBALERT = 0x02,
+	INTR_TEST = 0x03
+};
+
+/*
+ * For the PERSIST bit field of the interrupt control register
+ *
+ * Determines when interrupts occur.
+ * PERSIST_EVERY interrupts on every cycle.
+ * PERSIST_N interrupts if the value remains outside the threshold window for
+ * N integration cycles.
+ */
+enum tsl2561_persist {
+	PERSIST_EVERY = 0x00,
+	PERSIST_1 = 0x01,
+	PERSIST_2 = 0x02,
+	PERSIST_3 = 0x03,
+	PERSIST_4 = 0x04,
+	PERSIST_5 = 0x05,
+	PERSIST_6 = 0x06,
+	PERSIST_7 = 0x07,
+	PERSIST_8 = 0x08,
+	PERSIST_9 = 0x09,
+	PERSIST_10 = 0x0A,
+	PERSIST_11 = 0x0B,
+	PERSIST_12 = 0x0C,
+	PERSIST_13 = 0x0D,
+	PERSIST_14 = 0x0E,
+	PERSIST_15 = 0x0F
+};
+
+// Used to separate IIO channels. Also the scan index of buffered channels
+enum tsl2561_channel_id {
+	CHANNEL_DATA0,
+	CHANNEL_DATA1,
+	CHANNEL_TIMESTAMP
+};
+
+// Record queued by the polling core, which fills in the timestamp
+struct tsl2561_poll_record {
+	u64 timestamp; // CLOCK_MONOTONIC in nanoseconds
+	u16 ch0, ch1;
+};
+
+struct tsl2561_data {
+	struct iio_dev *indio_dev;
+	struct i2c_client *client;
+	struct regmap *regmap;
+	struct mutex lock; // protects data state
+	enum tsl2561_package_type package; // picks the lux coefficients
+	enum tsl2561_gain gain;
+	enum tsl2561_integ_time integ_time;
+	ktime_t settle_time; // data is valid one integration after this
+	ktime_t channels_time; // when ch0 and ch1 were read
+	bool channels_valid;
+	u16 ch0, ch1;
+	bool auto_range; // picks gain and integ_time from the last reading
+	u32 manual_us; // requested window with INTEG_TIME_MANUAL
+	u32 window_us; // measured length of the last manual window
+	struct iio_trigger *drdy_trig; // only with an interrupt line
+	bool drdy_enabled;
+	bool events_enabled; // threshold events, exclusive with drdy_enabled
+	enum tsl2561_persist persist; // cycles out of the window per event
+	s64 irq_timestamp;
+	// Polls for the buffer when no trigger is set. Paused while disabled
+	struct sensor_poll poll;
+	bool poll_enabled; // buffer in software mode, exclusive with manual
+	// Buffer scan, pushed by the trigger handler or the poll
+	struct {
+		u16 channels[2];
+		s64 timestamp __aligned(8);
+	} scan;
+};
+
+static bool tsl2561_readable_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_CONTROL ... REG_INTERRUPT:
+	case REG_ID:
+	case REG_DATA_0_LOW ... REG_DATA_1_HIGH:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool tsl2561_writeable_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_CONTROL ... REG_INTERRUPT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Only the ADC data changes without the driver writing to it
+static bool tsl2561_volatile_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_DATA_0_LOW ... REG_DATA_1_HIGH:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Every register access needs the CMD bit set in the command byte
+static const struct regmap_config tsl2561_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = REG_DATA_1_HIGH,
+	.read_flag_mask = CMD_BIT,
+	.write_flag_mask = CMD_BIT,
+	.readable_reg = tsl2561_readable_reg,
+	.writeable_reg = tsl2561_writeable_reg,
+	.volatile_reg = tsl2561_volatile_reg,
+	.cache_type = REGCACHE_MAPLE,
+};
+
+// Takes the first (lsb) byte and converts into a word
+static inline u16 get_u16_le(const u8 *reg)
+{
+	return (reg[1] << 8) | reg[0];
+}
+
+/*
+ * Writes the GAIN and INTEG bits of the timing register. The read comes from
+ * the register cache, and nothing is written if the bits are already set.
+ *
+ * The ADC data only reflects the new settings after the next full
+ * integration, so the channel cache is dropped and reads wait for it.
+ */
+static int set_timing(struct tsl2561_data *data,
+		      enum tsl2561_integ_time integ_time,
+		      enum tsl2561_gain gain)
+{
+	int ret;
+
+	if (integ_time == data->integ_time && gain == data->gain)
+		return 0;
+
+	ret = regmap_update_bits(data->regmap, REG_TIMING,
+				 GAIN_MASK | INTEG_TIME_MASK,
+				 (gain << GAIN_SHIFT) |
+				 (integ_time & INTEG_TIME_MASK));
+	if (ret)
+		return ret;
+
+	data->integ_time = integ_time;
+	data->gain = gain;
+	data->settle_time = ktime_get();
+	data->channels_valid = false;
+
+	trace_tsl2561_set_timing(&data->client->dev, integ_time,
+				 gain == GAIN_16x);
+
+	return 0;
+}
+
+struct tsl2561_range {
+	enum tsl2561_integ_time integ_time;
+	enum tsl2561_gain gain;
+};
+
+// Fastest integration time first, and the higher gain first for each
+static const struct tsl2561_range tsl2561_ranges[] = {
+	{ INTEG_TIME_13MS, GAIN_16x },
+	{ INTEG_TIME_13MS, GAIN_1x },
+	{ INTEG_TIME_101MS, GAIN_16x },
+	{ INTEG_TIME_101MS, GAIN_1x },
+	{ INTEG_TIME_402MS, GAIN_16x },
+	{ INTEG_TIME_402MS, GAIN_1x }
+};
+
+// Counts where the ADC saturates, since shorter cycles can't count as high
+static u32 range_saturation(enum tsl2561_integ_time integ_time)
+{
+	switch (integ_time) {
+	case INTEG_TIME_13MS:
+		return 5047;
+	case INTEG_TIME_101MS:
+		return 37177;
+	default:
+		return 65535;
+	}
+}
+
+// Actual length of the fixed integration times
+static u32 fixed_integ_time_us(enum tsl2561_integ_time integ_time)
+{
+	switch (integ_time) {
+	case INTEG_TIME_13MS:
+		return TSL2561_INTEG_13MS_US;
+	case INTEG_TIME_101MS:
+		return TSL2561_INTEG_101MS_US;
+	default:
+		return TSL2561_INTEG_402MS_US;
+	}
+}
+
+// Length of the current integration, measured for manual windows
+static u32 integ_time_us(struct tsl2561_data *data)
+{
+	if (data->integ_time == INTEG_TIME_MANUAL)
+		return data->window_us;
+
+	return fixed_integ_time_us(data->integ_time);
+}
+
+// Counts per unit of light, as gain times integration time in 0.1ms
+static u32 range_sensitivity(u32 integ_us, enum tsl2561_gain gain)
+{
+	u32 scale = max(integ_us / 100, 1U);
+
+	return gain == GAIN_16x ? scale * 16 : scale;
+}
+
+/*
+ * Picks the range for the next reading from the last one.
+ *
+ * The counts are scaled to what every range would read. The fastest range
+ * giving at least AUTO_RANGE_MIN_COUNTS without getting near saturation is
+ * used, otherwise the one with the most counts. A saturated reading can't be
+ * scaled, so jumps straight to the least sensitive range. Either way it
+ * usually settles after one more reading.
+ *
+ * Threshold events and buffered scans carry raw counts without a scale, so
+ * ranging pauses while either is on.
+ *
+ * Returns 1 if the range changed.
+ */
+static int auto_range(struct tsl2561_data *data)
+{
+	const struct tsl2561_range *best = NULL;
+	u32 counts = max3(data->ch0, data->ch1, (u16)1);
+	u32 sens = range_sensitivity(integ_time_us(data), data->gain);
+	u64 best_counts = 0;
+	int i, ret;
+
+	if (!data->auto_range || data->events_enabled ||
+	    iio_buffer_enabled(data->indio_dev))
+		return 0;
+
+	if (counts >= range_saturation(data->integ_time)) {
+		best = &tsl2561_ranges[RANGE_LEAST_SENSITIVE];
+		goto set;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tsl2561_ranges); i++) {
+		const struct tsl2561_range *range = &tsl2561_ranges[i];
+		u64 predicted = div_u64((u64)counts *
+					range_sensitivity(
+						fixed_integ_time_us(range->integ_time),
+						range->gain),
+					sens);
+
+		// Leaves 10% headroom for the light getting brighter
+		if (predicted * 10 >= range_saturation(range->integ_time) * 9)
+			continue;
+
+		if (predicted >= AUTO_RANGE_MIN_COUNTS) {
+			best = range;
+			break;
+		}
+
+		if (predicted > best_counts) {
+			best = range;
+			best_counts = predicted;
+		}
+	}
+
+	if (!best)
+		best = &tsl2561_ranges[RANGE_LEAST_SENSITIVE];
+
+set:
+	if (best->integ_time == data->integ_time && best->gain == data->gain)
+		return 0;
+
+	ret = set_timing(data, best->integ_time, best->gain);
+	if (ret)
+		return ret;
+
+	return 1;
+}
+
+static ssize_t in_illuminance_gain_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	// gain is an enum and is either 0/1 but represents 1/16
+	// so this is a simple math formula to get f(0) = 1 and f(1) = 16
+	// probably better and easier than a switchcase for each albeit less
+	// clear
+	ret = sysfs_emit(buf, "%d\n", data->gain * 15 + 1);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static ssize_t in_illuminance_gain_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	enum tsl2561_gain gain;
+	int val, ret;
+
+	if (kstrtoint(buf, 10, &val))
+		return -EINVAL;
+
+	switch (val) {
+	case 1:
+		gain = GAIN_1x;
+		break;
+	case 16:
+		gain = GAIN_16x;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	// Choosing a gain by hand turns auto-ranging off
+	data->auto_range = false;
+	ret = set_timing(data, data->integ_time, gain);
+	mutex_unlock(&data->lock);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(in_illuminance_gain);
+
+static ssize_t in_illuminance_auto_range_show(struct device *dev,
+					      struct device_attribute *attr,
+					      char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	ret = sysfs_emit(buf, "%d\n", data->auto_range);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static ssize_t in_illuminance_auto_range_store(struct device *dev,
+					       struct device_attribute *attr,
+					       const char *buf, size_t count)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	bool val;
+	int ret;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	data->auto_range = val;
+	mutex_unlock(&data->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(in_illuminance_auto_range);
+
+static struct attribute *tsl2561_attributes[] = {
+	&dev_attr_in_illuminance_gain.attr,
+	&dev_attr_in_illuminance_auto_range.attr,
+	NULL
+};
+
+static const struct attribute_group tsl2561_attr_group = {
+	.name = NULL,
+	.attrs = tsl2561_attributes
+};
+
+// Only the fixed times. Manual windows are set in microseconds instead
+static int integ_time_int_to_enum(int val, enum tsl2561_integ_time *out)
+{
+	switch (val) {
+	case 13:
+		*out = INTEG_TIME_13MS;
+		break;
+	case 101:
+		*out = INTEG_TIME_101MS;
+		break;
+	case 402:
+		*out = INTEG_TIME_402MS;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int integ_time_enum_to_int(enum tsl2561_integ_time val)
+{
+	switch (val) {
+	case INTEG_TIME_13MS:
+		return 13;
+	case INTEG_TIME_101MS:
+		return 101;
+	case INTEG_TIME_402MS:
+		return 402;
+	default:
+		return -EINVAL;
+	}
+}
+
+// Writes the POWER bits and notes when the sensor was powered on
+static int set_power(struct tsl2561_data *data, enum tsl2561_power power)
+{
+	int ret;
+
+	ret = regmap_write(data->regmap, REG_CONTROL, power);
+	if (ret)
+		return ret;
+
+	if (power == POWER_ON)
+		data->settle_time = ktime_get();
+
+	data->channels_valid = false;
+
+	return 0;
+}
+
+/*
+ * The ADC registers read as zero until the first integration after power on
+ * completes, so waits for it if needed
+ */
+static void wait_first_integration(struct tsl2561_data *data)
+{
+	int integ_ms = integ_time_enum_to_int(data->integ_time);
+	s64 elapsed_ms = ktime_ms_delta(ktime_get(), data->settle_time);
+
+	if (integ_ms < 0)
+		return;
+
+	// Actual times are slightly longer than the nominal ones, e.g. 13.7ms
+	integ_ms++;
+
+	if (elapsed_ms < integ_ms)
+		msleep(integ_ms - elapsed_ms);
+}
+
+/*
+ * Integrates for manual_us between a MANUAL_START and a MANUAL_STOP write.
+ *
+ * The stop has to be written from process context, so instead of a timer
+ * callback the thread sleeps on an hrtimer set to an absolute time from the
+ * start. The time between the two writes is kept in window_us, since that is
+ * what the ADC actually counted for.
+ *
+ * Windows go up to 5s, so the sleep is interruptible. A signal still stops
+ * the integration, but the partial window is thrown away.
+ */
+static int manual_integration(struct tsl2561_data *data)
+{
+	bool interrupted = false;
+	ktime_t start, expires;
+	int ret;
+
+	ret = regmap_update_bits(data->regmap, REG_TIMING, MANUAL_MASK,
+				 MANUAL_START << MANUAL_SHIFT);
+	if (ret)
+		return ret;
+
+	start = ktime_get();
+	expires = ktime_add_us(start, data->manual_us);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!schedule_hrtimeout_range(&expires, MANUAL_SLACK_NS,
+					      HRTIMER_MODE_ABS))
+			break;
+
+		if (signal_pending(current)) {
+			interrupted = true;
+			break;
+		}
+	}
+
+	ret = regmap_update_bits(data->regmap, REG_TIMING, MANUAL_MASK,
+				 MANUAL_STOP << MANUAL_SHIFT);
+	if (ret)
+		return ret;
+
+	if (interrupted)
+		return -ERESTARTSYS;
+
+	data->window_us = max_t(s64, ktime_us_delta(ktime_get(), start), 1);
+
+	return 0;
+}
+
+/*
+ * Reads both channels into ch0 and ch1 in a single 4 byte transaction, so
+ * they always come from the same integration cycle.
+ *
+ * The register address auto-increments until the stop condition on I2C, so
+ * only CMD_BIT is set. BLOCK_BIT is for the SMBus block protocol, which
+ * returns a byte count first.
+ *
+ * The sensor has no new data until the next integration completes, so
+ * readings less than one integration time old are reused without touching
+ * the bus.
+ */
+static int read_channels(struct tsl2561_data *data)
+{
+	int integ_ms = integ_time_enum_to_int(data->integ_time);
+	u8 reg_data[4];
+	int ret;
+
+	if (data->channels_valid && integ_ms > 0 &&
+	    ktime_ms_delta(ktime_get(), data->channels_time) < integ_ms)
+		return 0;
+
+	if (data->integ_time == INTEG_TIME_MANUAL) {
+		ret = manual_integration(data);
+		if (ret)
+			return ret;
+	} else {
+		wait_first_integration(data);
+	}
+
+	ret = regmap_bulk_read(data->regmap, REG_DATA_0_LOW, reg_data,
+			       sizeof(reg_data));
+	if (ret)
+		return ret;
+
+	data->ch0 = get_u16_le(&reg_data[0]);
+	data->ch1 = get_u16_le(&reg_data[2]);
+	data->channels_time = ktime_get();
+	data->channels_valid = true;
+
+	trace_tsl2561_read_channels(&data->client->dev, data->ch0, data->ch1,
+				    integ_time_us(data), data->gain == GAIN_16x);
+
+	return 0;
+}
+
+/*
+ * Reads both channels, then reads again at the new range if auto-ranging
+ * changed it, so the values are usable
+ */
+static int read_settled_channels(struct tsl2561_data *data)
+{
+	int tries;
+	int ret;
+
+	ret = read_channels(data);
+
+	for (tries = 0; !ret && tries < AUTO_RANGE_TRIES; tries++) {
+		ret = auto_range(data);
+		if (ret <= 0)
+			break;
+
+		ret = read_channels(data);
+	}
+
+	return ret;
+}
+
+static int read_data_registers(struct tsl2561_data *data,
+			       struct iio_chan_spec const *chan)
+{
+	int ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	ret = read_settled_channels(data);
+	if (ret)
+		goto unlock;
+
+	switch (chan->address) {
+	case CHANNEL_DATA0:
+		ret = data->ch0;
+		break;
+	case CHANNEL_DATA1:
+		ret = data->ch1;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+unlock:
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * Computes lux from a settled reading of both channels.
+ *
+ * Returns -ERANGE if either channel is saturated, since the ratio between
+ * them is then meaningless
+ */
+static int read_lux(struct tsl2561_data *data, int *val, int *val2)
+{
+	u32 saturation;
+	u64 lux;
+	int ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	ret = read_settled_channels(data);
+	if (ret)
+		goto unlock;
+
+	saturation = range_saturation(data->integ_time);
+	if (data->ch0 >= saturation || data->ch1 >= saturation) {
+		ret = -ERANGE;
+		goto unlock;
+	}
+
+	lux = tsl2561_lux(data->package, data->ch0, data->ch1,
+			  tsl2561_ch_scale(integ_time_us(data),
+					   data->gain == GAIN_16x));
+
+	*val = lux >> TSL2561_LUX_SCALE;
+	*val2 = ((lux & ((1 << TSL2561_LUX_SCALE) - 1)) * 1000000) >>
+		TSL2561_LUX_SCALE;
+
+unlock:
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static int tsl2561_read_raw(struct iio_dev *indio_dev,
+			    struct iio_chan_spec const *chan,
+			    int *val, int *val2, long mask)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	struct device *dev = &data->client->dev;
+	u32 freq_uhz;
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret < 0)
+			return ret;
+
+		ret = read_data_registers(data, chan);
+
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+
+		if (ret < 0)
+			return ret;
+
+		*val = ret;
+
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_PROCESSED:
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret < 0)
+			return ret;
+
+		ret = read_lux(data, val, val2);
+
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+
+		if (ret)
+			return ret;
+
+		return IIO_VAL_INT_PLUS_MICRO;
+	case IIO_CHAN_INFO_INT_TIME:
+		// In milliseconds, with the microseconds of manual windows
+		// in val2
+		if (data->integ_time == INTEG_TIME_MANUAL) {
+			*val = data->manual_us / 1000;
+			*val2 = (data->manual_us % 1000) * 1000;
+
+			return IIO_VAL_INT_PLUS_MICRO;
+		}
+
+		*val = integ_time_enum_to_int(data->integ_time);
+		if (*val < 0)
+			return -EINVAL;
+
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		// Of the software buffer polling, in Hz
+		freq_uhz = div_u64(1000000000ULL,
+				   sensor_poll_interval(&data->poll));
+		*val = freq_uhz / 1000000;
+		*val2 = freq_uhz % 1000000;
+
+		return IIO_VAL_INT_PLUS_MICRO;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int tsl2561_write_raw(struct iio_dev *indio_dev,
+			     struct iio_chan_spec const *chan,
+			     int val, int val2, long mask)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	enum tsl2561_integ_time integ_time;
+	s64 manual_us;
+	u64 freq_uhz;
+	u32 interval_ms;
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_INT_TIME:
+		/*
+		 * 13, 101 and 402 pick the fixed times. Anything else is a
+		 * manual window, e.g. 0.5 for 500us or 2000 for two seconds
+		 */
+		manual_us = (s64)val * 1000 + val2 / 1000;
+		if (val2 || integ_time_int_to_enum(val, &integ_time)) {
+			if (val < 0 || val2 < 0 || manual_us < MANUAL_MIN_US ||
+			    manual_us > MANUAL_MAX_US) {
+				ret = -EINVAL;
+				goto err;
+			}
+
+			integ_time = INTEG_TIME_MANUAL;
+		}
+
+		ret = mutex_lock_interruptible(&data->lock);
+		if (ret)
+			goto err;
+
+		if (integ_time == INTEG_TIME_MANUAL) {
+			/*
+			 * Interrupts only come from the sensor's own cycles,
+			 * and a window inside the polling core would hold up
+			 * every other sensor on the adapter
+			 */
+			if (data->drdy_enabled || data->events_enabled ||
+			    data->poll_enabled) {
+				ret = -EBUSY;
+				goto unlock_err;
+			}
+
+			data->manual_us = manual_us;
+		}
+
+		// Choosing a time by hand turns auto-ranging off
+		data->auto_range = false;
+		ret = set_timing(data, integ_time, data->gain);
+		if (ret < 0)
+			goto unlock_err;
+
+		mutex_unlock(&data->lock);
+
+		return 0;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		// In Hz, rounded to a whole number of milliseconds between polls
+		if (val < 0 || val2 < 0) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		freq_uhz = (u64)val * 1000000 + val2;
+		if (!freq_uhz) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		interval_ms = DIV_ROUND_CLOSEST_ULL(1000000000ULL, freq_uhz);
+		if (interval_ms < POLL_INTERVAL_MIN_MS ||
+		    interval_ms > POLL_INTERVAL_MAX_MS) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		sensor_poll_set_interval(&data->poll, interval_ms);
+
+		return 0;
+	default:
+		ret = -EINVAL;
+		goto err;
+	}
+
+unlock_err:
+	mutex_unlock(&data->lock);
+err:
+	return ret;
+}
+
+/*
+ * CH0 is compared against the low and high thresholds after every
+ * integration cycle. Each is a 16 bit little endian register pair
+ */
+static unsigned int thresh_reg(enum iio_event_direction dir)
+{
+	return dir == IIO_EV_DIR_RISING ? REG_THRESH_HIGH_LOW :
+					  REG_THRESH_LOW_LOW;
+}
+
+// Writes the INTR and PERSIST fields for threshold events
+static int write_event_interrupt(struct tsl2561_data *data, bool enable)
+{
+	u8 intr = enable ? INTR_LEVEL_INTERRUPT : INTR_DISABLED;
+
+	return regmap_update_bits(data->regmap, REG_INTERRUPT,
+				  INTR_MASK | PERSIST_MASK,
+				  (intr << INTR_SHIFT) | data->persist);
+}
+
+static int tsl2561_read_event_value(struct iio_dev *indio_dev,
+				    const struct iio_chan_spec *chan,
+				    enum iio_event_type type,
+				    enum iio_event_direction dir,
+				    enum iio_event_info info,
+				    int *val, int *val2)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	u8 reg_data[2];
+	int integ_ms;
+	u64 period_us;
+	int ret;
+
+	switch (info) {
+	case IIO_EV_INFO_VALUE:
+		// Comes from the register cache after the first read
+		ret = mutex_lock_interruptible(&data->lock);
+		if (ret)
+			return ret;
+
+		ret = regmap_bulk_read(data->regmap, thresh_reg(dir), reg_data,
+				       sizeof(reg_data));
+		mutex_unlock(&data->lock);
+		if (ret)
+			return ret;
+
+		*val = get_u16_le(reg_data);
+
+		return IIO_VAL_INT;
+	case IIO_EV_INFO_PERIOD:
+		// Persistence is counted in integration cycles
+		ret = mutex_lock_interruptible(&data->lock);
+		if (ret)
+			return ret;
+
+		integ_ms = integ_time_enum_to_int(data->integ_time);
+		period_us = (u64)data->persist * integ_ms * 1000;
+		mutex_unlock(&data->lock);
+		if (integ_ms < 0)
+			return -EINVAL;
+
+		*val = div_u64_rem(period_us, 1000000, val2);
+
+		return IIO_VAL_INT_PLUS_MICRO;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int tsl2561_write_event_value(struct iio_dev *indio_dev,
+				     const struct iio_chan_spec *chan,
+				     enum iio_event_type type,
+				     enum iio_event_direction dir,
+				     enum iio_event_info info,
+				     int val, int val2)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	u8 reg_data[2];
+	int integ_ms;
+	u64 period_us;
+	int ret;
+
+	switch (info) {
+	case IIO_EV_INFO_VALUE:
+		if (val < 0 || val > U16_MAX)
+			return -EINVAL;
+
+		reg_data[0] = val & 0xFF;
+		reg_data[1] = val >> 8;
+
+		ret = mutex_lock_interruptible(&data->lock);
+		if (ret)
+			return ret;
+
+		ret = regmap_bulk_write(data->regmap, thresh_reg(dir), reg_data,
+					sizeof(reg_data));
+		mutex_unlock(&data->lock);
+
+		return ret;
+	case IIO_EV_INFO_PERIOD:
+		if (val < 0 || val2 < 0)
+			return -EINVAL;
+
+		period_us = (u64)val * 1000000 + val2;
+
+		ret = mutex_lock_interruptible(&data->lock);
+		if (ret)
+			return ret;
+
+		integ_ms = integ_time_enum_to_int(data->integ_time);
+		if (integ_ms < 0) {
+			ret = -EINVAL;
+			goto unlock;
+		}
+
+		// Rounds to the nearest number of cycles the sensor supports
+		data->persist = clamp_t(u64,
+					DIV_ROUND_CLOSEST_ULL(period_us,
+							      integ_ms * 1000),
+					PERSIST_1, PERSIST_15);
+
+		ret = 0;
+		if (data->events_enabled)
+			ret = write_event_interrupt(data, true);
+unlock:
+		mutex_unlock(&data->lock);
+
+		return ret;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int tsl2561_read_event_config(struct iio_dev *indio_dev,
+				     const struct iio_chan_spec *chan,
+				     enum iio_event_type type,
+				     enum iio_event_direction dir)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		return ret;
+
+	ret = data->events_enabled;
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * The sensor has to keep integrating for the comparator to work, so an
+ * enable holds a runtime PM reference until the matching disable.
+ * The interrupt line is shared with the data-ready trigger, so only one of
+ * them can be on at a time.
+ */
+static int tsl2561_write_event_config(struct iio_dev *indio_dev,
+				      const struct iio_chan_spec *chan,
+				      enum iio_event_type type,
+				      enum iio_event_direction dir,
+				      bool state)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	struct device *dev = &data->client->dev;
+	bool changed = false;
+	int ret;
+
+	if (data->client->irq <= 0)
+		return -ENODEV;
+
+	// Taken before the lock since resuming takes it too
+	ret = pm_runtime_resume_and_get(dev);
+	if (ret < 0)
+		return ret;
+
+	ret = mutex_lock_interruptible(&data->lock);
+	if (ret)
+		goto put;
+
+	if (data->drdy_enabled ||
+	    (state && data->integ_time == INTEG_TIME_MANUAL)) {
+		ret = -EBUSY;
+	} else if (state != data->events_enabled) {
+		ret = write_event_interrupt(data, state);
+		if (!ret) {
+			data->events_enabled = state;
+			changed = true;
+		}
+	}
+
+	mutex_unlock(&data->lock);
+
+	// Keeps the reference for as long as events are enabled
+	if (changed && state)
+		return 0;
+
+	// Drops the reference that the enable kept
+	if (changed && !state)
+		pm_runtime_put_noidle(dev);
+
+put:
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
+	return ret;
+}
+
+static const struct iio_info tsl2561_info = {
+	.read_raw = tsl2561_read_raw,
+	.write_raw = tsl2561_write_raw,
+	.read_event_value = tsl2561_read_event_value,
+	.write_event_value = tsl2561_write_event_value,
+	.read_event_config = tsl2561_read_event_config,
+	.write_event_config = tsl2561_write_event_config,
+	.attrs = &tsl2561_attr_group
+};
+
+// Rising uses the high threshold and falling the low one
+static const struct iio_event_spec tsl2561_events[] = {
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_RISING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE)
+	},
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_FALLING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE)
+	},
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_EITHER,
+		.mask_separate = BIT(IIO_EV_INFO_ENABLE) |
+				 BIT(IIO_EV_INFO_PERIOD)
+	}
+};
+
+static const struct iio_chan_spec tsl2561_channels[] = {
+	{
+		.type = IIO_LIGHT,
+		.modified = true,
+		.channel = 0,
+		.channel2 = IIO_MOD_LIGHT_BOTH,
+		.address = CHANNEL_DATA0,
+		.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+		.event_spec = tsl2561_events,
+		.num_event_specs = ARRAY_SIZE(tsl2561_events),
+		.scan_index = CHANNEL_DATA0,
+		.scan_type = {
+			.sign = 'u',
+			.realbits = 16,
+			.storagebits = 16,
+			.endianness = IIO_CPU
+		}
+	},
+	{
+		.type = IIO_LIGHT,
+		.modified = true,
+		.channel = 1,
+		.channel2 = IIO_MOD_LIGHT_IR,
+		.address = CHANNEL_DATA1,
+		.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+		.scan_index = CHANNEL_DATA1,
+		.scan_type = {
+			.sign = 'u',
+			.realbits = 16,
+			.storagebits = 16,
+			.endianness = IIO_CPU
+		}
+	},
+	{
+		.type = IIO_LIGHT,
+		.channel = 2,
+		.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED) |
+				      BIT(IIO_CHAN_INFO_INT_TIME),
+		.info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),
+		.scan_index = -1
+	},
+	IIO_CHAN_SOFT_TIMESTAMP(CHANNEL_TIMESTAMP)
+};
+
+/*
+ * Both channels come from one transaction and are always pushed at fixed
+ * offsets, so the core reads both and hands out the ones that were enabled
+ */
+static const unsigned long tsl2561_scan_masks[] = {
+	BIT(CHANNEL_DATA0) | BIT(CHANNEL_DATA1),
+	0
+};
+
+// Reads both channels and pushes them with the trigger's timestamp
+static irqreturn_t tsl2561_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	s64 timestamp;
+	int ret;
+
+	// Nested polls from the data-ready trigger skip the pollfunc top half
+	if (iio_trigger_using_own(indio_dev))
+		timestamp = data->irq_timestamp;
+	else
+		timestamp = pf->timestamp;
+
+	mutex_lock(&data->lock);
+
+	ret = read_channels(data);
+	if (!ret) {
+		data->scan.channels[CHANNEL_DATA0] = data->ch0;
+		data->scan.channels[CHANNEL_DATA1] = data->ch1;
+	}
+
+	mutex_unlock(&data->lock);
+
+	if (!ret)
+		iio_push_to_buffers_with_timestamp(indio_dev, &data->scan,
+						   timestamp);
+
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+// Keeps the sensor powered for as long as the buffer is enabled
+static int tsl2561_buffer_preenable(struct iio_dev *indio_dev)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+
+	return pm_runtime_resume_and_get(&data->client->dev);
+}
+
+/*
+ * Without a trigger, the polling core reads the sensor for the buffer.
+ *
+ * The core reads every sensor on the adapter from one work item, so manual
+ * windows of up to MANUAL_MAX_US are refused while it polls. A failed
+ * postenable still gets the postdisable, which clears poll_enabled.
+ */
+static int tsl2561_buffer_postenable(struct iio_dev *indio_dev)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	int ret = 0;
+
+	if (iio_device_get_current_mode(indio_dev) != INDIO_BUFFER_SOFTWARE)
+		return 0;
+
+	mutex_lock(&data->lock);
+	if (data->integ_time == INTEG_TIME_MANUAL)
+		ret = -EBUSY;
+	else
+		data->poll_enabled = true;
+	mutex_unlock(&data->lock);
+
+	if (!ret)
+		sensor_poll_resume(&data->poll);
+
+	return ret;
+}
+
+static int tsl2561_buffer_predisable(struct iio_dev *indio_dev)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+
+	sensor_poll_pause(&data->poll);
+
+	return 0;
+}
+
+static int tsl2561_buffer_postdisable(struct iio_dev *indio_dev)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+
+	mutex_lock(&data->lock);
+	data->poll_enabled = false;
+	mutex_unlock(&data->lock);
+
+	pm_runtime_mark_last_busy(&data->client->dev);
+	pm_runtime_put_autosuspend(&data->client->dev);
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops tsl2561_buffer_ops = {
+	.preenable = tsl2561_buffer_preenable,
+	.postenable = tsl2561_buffer_postenable,
+	.predisable = tsl2561_buffer_predisable,
+	.postdisable = tsl2561_buffer_postdisable
+};
+
+static int tsl2561_poll_read(struct sensor_poll *poll, void *record)
+{
+	struct tsl2561_data *data = container_of(poll, struct tsl2561_data,
+						 poll);
+	struct tsl2561_poll_record *rec = record;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	ret = read_channels(data);
+	if (!ret) {
+		rec->ch0 = data->ch0;
+		rec->ch1 = data->ch1;
+	}
+
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+/*
+ * Pushes the queued readings to the buffer. The trigger handler never runs
+ * in software buffer mode, so the scan is free to use.
+ *
+ * The core timestamps with CLOCK_MONOTONIC, which is converted to the clock
+ * picked for the iio device by subtracting the reading's age.
+ */
+static void tsl2561_poll_notify(struct sensor_poll *poll)
+{
+	struct tsl2561_data *data = container_of(poll, struct tsl2561_data,
+						 poll);
+	struct tsl2561_poll_record rec;
+	s64 age;
+
+	while (sensor_poll_out(poll, &rec, 1)) {
+		age = ktime_get_ns() - rec.timestamp;
+		data->scan.channels[CHANNEL_DATA0] = rec.ch0;
+		data->scan.channels[CHANNEL_DATA1] = rec.ch1;
+		iio_push_to_buffers_with_timestamp(data->indio_dev, &data->scan,
+						   iio_get_time_ns(data->indio_dev) -
+						   age);
+	}
+}
+
+static const struct sensor_poll_ops tsl2561_poll_ops = {
+	.read = tsl2561_poll_read,
+	.notify = tsl2561_poll_notify
+};
+
+/*
+ * Enables the interrupt at the end of every integration cycle for the
+ * data-ready trigger
+ */
+static int tsl2561_drdy_set_state(struct iio_trigger *trig, bool state)
+{
+	struct iio_dev *indio_dev = iio_trigger_get_drvdata(trig);
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	u8 intr = state ? INTR_LEVEL_INTERRUPT : INTR_DISABLED;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	if (state && (data->events_enabled ||
+		      data->integ_time == INTEG_TIME_MANUAL)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	ret = regmap_update_bits(data->regmap, REG_INTERRUPT,
+				 INTR_MASK | PERSIST_MASK,
+				 (intr << INTR_SHIFT) | PERSIST_EVERY);
+	if (!ret)
+		data->drdy_enabled = state;
+
+unlock:
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static const struct iio_trigger_ops tsl2561_trigger_ops = {
+	.set_trigger_state = tsl2561_drdy_set_state
+};
+
+static irqreturn_t tsl2561_irq_handler(int irq, void *private)
+{
+	struct iio_dev *indio_dev = private;
+	struct tsl2561_data *data = iio_priv(indio_dev);
+
+	data->irq_timestamp = iio_get_time_ns(indio_dev);
+
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * The interrupt stays asserted until cleared with a CLEAR_BIT command. A new
+ * integration cycle has completed, so the channel cache is dropped before
+ * triggering.
+ *
+ * For threshold events the sensor does not say which threshold was crossed,
+ * so CH0 is read back and compared against both.
+ */
+static irqreturn_t tsl2561_irq_thread(int irq, void *private)
+{
+	struct iio_dev *indio_dev = private;
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	enum iio_event_direction dir = IIO_EV_DIR_NONE;
+	bool drdy, events;
+	u8 thresh[4];
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	ret = i2c_smbus_write_byte(data->client, CMD_BIT | CLEAR_BIT);
+	if (ret < 0)
+		dev_err_ratelimited(&data->client->dev,
+				    "failed to clear interrupt\n");
+
+	data->channels_valid = false;
+	drdy = data->drdy_enabled;
+	events = data->events_enabled;
+
+	if (events) {
+		// Low then high threshold, from the register cache
+		ret = regmap_bulk_read(data->regmap, REG_THRESH_LOW_LOW, thresh,
+				       sizeof(thresh));
+		if (!ret)
+			ret = read_channels(data);
+		if (!ret && data->ch0 > get_u16_le(&thresh[2]))
+			dir = IIO_EV_DIR_RISING;
+		else if (!ret && data->ch0 < get_u16_le(&thresh[0]))
+			dir = IIO_EV_DIR_FALLING;
+	}
+
+	mutex_unlock(&data->lock);
+
+	if (drdy && iio_trigger_using_own(indio_dev))
+		iio_trigger_poll_nested(data->drdy_trig);
+
+	if (dir != IIO_EV_DIR_NONE)
+		iio_push_event(indio_dev,
+			       IIO_MOD_EVENT_CODE(IIO_LIGHT, 0,
+						  IIO_MOD_LIGHT_BOTH,
+						  IIO_EV_TYPE_THRESH, dir),
+			       data->irq_timestamp);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Sets up the data-ready trigger on the interrupt line and makes it the
+ * default. The same line carries threshold events
+ */
+static int tsl2561_setup_irq(struct iio_dev *indio_dev)
+{
+	struct tsl2561_data *data = iio_priv(indio_dev);
+	struct device *dev = &data->client->dev;
+	int ret;
+
+	data->drdy_trig = devm_iio_trigger_alloc(dev, "%s-dev%d",
+						 indio_dev->name,
+						 iio_device_id(indio_dev));
+	if (!data->drdy_trig)
+		return -ENOMEM;
+
+	data->drdy_trig->ops = &tsl2561_trigger_ops;
+	iio_trigger_set_drvdata(data->drdy_trig, indio_dev);
+
+	ret = devm_iio_trigger_register(dev, data->drdy_trig);
+	if (ret)
+		return ret;
+
+	indio_dev->trig = iio_trigger_get(data->drdy_trig);
+
+	return devm_request_threaded_irq(dev, data->client->irq,
+					 tsl2561_irq_handler,
+					 tsl2561_irq_thread, IRQF_ONESHOT,
+					 indio_dev->name, indio_dev);
+}
+
+static int tsl2561_runtime_suspend(struct device *dev)
+{
+	struct tsl2561_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	int ret;
+
+	mutex_lock(&data->lock);
+	ret = set_power(data, POWER_OFF);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static int tsl2561_runtime_resume(struct device *dev)
+{
+	struct tsl2561_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	int ret;
+
+	mutex_lock(&data->lock);
+	ret = set_power(data, POWER_ON);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static DEFINE_RUNTIME_DEV_PM_OPS(tsl2561_pm_ops, tsl2561_runtime_suspend,
+				 tsl2561_runtime_resume, NULL);
+
+// devm action so the sensor is powered off after the iio device is gone
+static void tsl2561_power_off(void *data)
+{
+	set_power(data, POWER_OFF);
+}
+
+// devm actions for the polling core
+static void tsl2561_poll_free(void *poll)
+{
+	sensor_poll_free(poll);
+}
+
+static void tsl2561_poll_stop(void *poll)
+{
+	sensor_poll_stop(poll);
+}
+
+static int tsl2561_probe(struct i2c_client *client)
+{
+	struct iio_dev *indio_dev;
+	struct tsl2561_data *data;
+	unsigned int timing;
+	int ret;
+
+	indio_dev = devm_iio_device_alloc(&client->dev, sizeof(*data));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	data = iio_priv(indio_dev);
+	data->client = client;
+	data->package = i2c_client_get_device_id(client)->driver_data;
+	data->indio_dev = indio_dev;
+	mutex_init(&data->lock);
+
+	data->regmap = devm_regmap_init_i2c(client, &tsl2561_regmap_config);
+	if (IS_ERR(data->regmap))
+		return PTR_ERR(data->regmap);
+
+	i2c_set_clientdata(client, data);
+
+	ret = set_power(data, POWER_ON);
+	if (ret) {
+		dev_err(&client->dev, "failed to power on\n");
+		return ret;
+	}
+
+	ret = devm_add_action_or_reset(&client->dev, tsl2561_power_off, data);
+	if (ret)
+		return ret;
+
+	// Starts from what the sensor is set to (402ms and 1x after reset)
+	ret = regmap_read(data->regmap, REG_TIMING, &timing);
+	if (ret)
+		return ret;
+
+	data->integ_time = timing & INTEG_TIME_MASK;
+	data->gain = (timing & GAIN_MASK) >> GAIN_SHIFT;
+	data->persist = PERSIST_1;
+	data->manual_us = TSL2561_INTEG_402MS_US;
+	data->window_us = data->manual_us;
+
+	// Sensors on the same adapter, e.g. a bmp280, are polled together
+	ret = sensor_poll_init(&data->poll, &tsl2561_poll_ops, client->adapter,
+			       sizeof(struct tsl2561_poll_record),
+			       POLL_FIFO_SIZE, TSL2561_INTEG_402MS_US / 1000);
+	if (ret)
+		return ret;
+
+	ret = devm_add_action_or_reset(&client->dev, tsl2561_poll_free,
+				       &data->poll);
+	if (ret)
+		return ret;
+
+	/*
+	 * Started paused before the buffer can be enabled, and stopped after
+	 * the iio device is gone. The counters sit under the i2c device, since
+	 * the iio device isn't in sysfs yet
+	 */
+	sensor_poll_pause(&data->poll);
+	ret = sensor_poll_start(&data->poll, &client->dev.kobj);
+	if (ret)
+		return ret;
+
+	ret = devm_add_action_or_reset(&client->dev, tsl2561_poll_stop,
+				       &data->poll);
+	if (ret)
+		return ret;
+
+	// Powered on above, so starts active and powers off once unused for
+	// AUTOSUSPEND_MS. Held until probe is done
+	pm_runtime_get_noresume(&client->dev);
+	pm_runtime_set_active(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev, AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	ret = devm_pm_runtime_enable(&client->dev);
+	if (ret) {
+		pm_runtime_put_noidle(&client->dev);
+		return ret;
+	}
+
+	indio_dev->dev.parent = &client->dev;
+	indio_dev->name = "tsl2561";
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->info = &tsl2561_info;
+	indio_dev->channels = tsl2561_channels;
+	indio_dev->num_channels = ARRAY_SIZE(tsl2561_channels);
+	indio_dev->available_scan_masks = tsl2561_scan_masks;
+
+	// Works with any trigger, e.g. iio-trig-hrtimer
+	ret = devm_iio_triggered_buffer_setup(&client->dev, indio_dev,
+					      iio_pollfunc_store_time,
+					      tsl2561_trigger_handler,
+					      &tsl2561_buffer_ops);
+	if (ret)
+		goto pm_put;
+
+	// Without a trigger the buffer is filled by polling instead
+	indio_dev->modes |= INDIO_BUFFER_SOFTWARE;
+
+	if (client->irq > 0) {
+		ret = tsl2561_setup_irq(indio_dev);
+		if (ret)
+			goto pm_put;
+	}
+
+	// Last, so userspace only sees the device once it is fully set up
+	ret = devm_iio_device_register(&client->dev, indio_dev);
+	if (ret)
+		goto pm_put;
+
+	dev_info(&client->dev, "tsl2561 probed\n");
+
+pm_put:
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+
+	return ret;
+}
+
+static const struct i2c_device_id tsl2561_id[] = {
+	{ "tsl2561", PACKAGE_T_FN_CL },
+	{ "tsl2561cs", PACKAGE_CS },
+	{}
+};
+MODULE_DEVICE_TABLE(i2c, tsl2561_id);
+
+static struct i2c_driver tsl2561_driver = {
+	.driver = {
+		.name = "tsl2561",
+		.pm = pm_ptr(&tsl2561_pm_ops)
+	},
+	.probe = tsl2561_probe,
+	.id_table = tsl2561_id
+};
+
+// This is awesome! Replaces the module_init() and module_exit() boilerplate
+module_i2c_driver(tsl2561_driver);
+
+MODULE_AUTHOR("Michael Harris <michaelharriscode@gmail.com>");
+MODULE_DESCRIPTION("TSL2561 driver using iio subsystem");
+MODULE_LICENSE("GPL");
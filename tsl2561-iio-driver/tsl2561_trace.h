@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for tsl2561 channel reads and timing changes
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tsl2561
+
+#if !defined(TSL2561_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define TSL2561_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/device.h>
+
+// Both channels read from the sensor. Reads served from the cache are not
+// traced
+TRACE_EVENT(tsl2561_read_channels,
+	TP_PROTO(struct device *dev, u16 ch0, u16 ch1, u32 integ_us,
+		 bool gain_16x),
+	TP_ARGS(dev, ch0, ch1, integ_us, gain_16x),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u16, ch0)
+		__field(u16, ch1)
+		__field(u32, integ_us)
+		__field(bool, gain_16x)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__entry->ch0 = ch0;
+		__entry->ch1 = ch1;
+		__entry->integ_us = integ_us;
+		__entry->gain_16x = gain_16x;
+	),
+
+	TP_printk("%s ch0=%u ch1=%u integ_us=%u gain=%s", __get_str(dev),
+		  __entry->ch0, __entry->ch1, __entry->integ_us,
+		  __entry->gain_16x ? "16x" : "1x")
+);
+
+// New INTEG and GAIN bits written to the timing register
+TRACE_EVENT(tsl2561_set_timing,
+	TP_PROTO(struct device *dev, u8 integ_time, bool gain_16x),
+	TP_ARGS(dev, integ_time, gain_16x),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, integ_time)
+		__field(bool, gain_16x)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__entry->integ_time = integ_time;
+		__entry->gain_16x = gain_16x;
+	),
+
+	TP_printk("%s integ_time=%u gain=%s", __get_str(dev),
+		  __entry->integ_time, __entry->gain_16x ? "16x" : "1x")
+);
+
+#endif /* TSL2561_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tsl2561_trace
+#include <trace/define_trace.h>
@@ -4,13 +4,21 @@
 #include <linux/atomic.h>
 #include "watchdog_timer.h"
 
+#define CREATE_TRACE_POINTS
+#include "watchdog_timer_trace.h"
+
 static struct hrtimer timer;
 
 static enum hrtimer_restart timer_callback(struct hrtimer *timer)
 {
+	int secs = atomic_read(&timeout);
+	u64 overruns;
+
 	pr_err("watchdog_timer: timed out\n");
 
-	hrtimer_forward_now(timer, ktime_set(atomic_read(&timeout), 0));
+	overruns = hrtimer_forward_now(timer, ktime_set(secs, 0));
+	trace_wtimer_timeout(secs, overruns);
+
 	return HRTIMER_RESTART;
 }
 
@@ -18,6 +26,8 @@ void wtimer_hrtimer_restart(void)
 {
 	wtimer_hrtimer_stop();
 	wtimer_hrtimer_start();
+
+	trace_wtimer_pet(atomic_read(&timeout));
 }
 
 void wtimer_hrtimer_start(void)
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the watchdog timer
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM watchdog_timer
+
+#if !defined(WATCHDOG_TIMER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define WATCHDOG_TIMER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// The timer was pet and starts over from timeout seconds
+TRACE_EVENT(wtimer_pet,
+	TP_PROTO(int timeout),
+	TP_ARGS(timeout),
+
+	TP_STRUCT__entry(
+		__field(int, timeout)
+	),
+
+	TP_fast_assign(
+		__entry->timeout = timeout;
+	),
+
+	TP_printk("timeout=%d", __entry->timeout)
+);
+
+// The timer ran out. overruns >1 means expiries were missed
+TRACE_EVENT(wtimer_timeout,
+	TP_PROTO(int timeout, u64 overruns),
+	TP_ARGS(timeout, overruns),
+
+	TP_STRUCT__entry(
+		__field(int, timeout)
+		__field(u64, overruns)
+	),
+
+	TP_fast_assign(
+		__entry->timeout = timeout;
+		__entry->overruns = overruns;
+	),
+
+	TP_printk("timeout=%d overruns=%llu",
+		  __entry->timeout, __entry->overruns)
+);
+
+#endif /* WATCHDOG_TIMER_TRACE_H */
+
+// Out of tree, so define_trace.h has to be told where this header is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE watchdog_timer_trace
+#include <trace/define_trace.h>